@@ -0,0 +1,795 @@
+/**
+  ******************************************************************************
+  * @file    wdc_base_emulator.cpp
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Host base-station emulator for load-testing the companion stack.
+  *
+  *          Runs the companion (wdc_comm.c and the layers below it) over the
+  *          loopback PHY on a simulated clock and plays the base: it frames
+  *          the bus with WDC_EN at the poll rate, acknowledges the
+  *          companion's transport segments, and mixes in its own data,
+  *          enumeration, request and event packets. Packets can be lost or
+  *          corrupted on the way in either direction.
+  *
+  *          It reports the sample sets delivered per second, the latency
+  *          from a reading being taken to it being decoded at the base,
+  *          and everything that was dropped on either side. Raise the
+  *          sample rate or lower the poll rate until readings are refused
+  *          to find where the companion saturates.
+  *
+  *          See README.md for how to build the host tools.
+  *
+  *          Usage: wdc_base_emulator [options]
+  *            -n frames        Bus frames to run (default 10000).
+  *            -r rate          Poll rate, frames per second (default 1000).
+  *            -s size          Size of the base's data packets in bytes,
+  *                             header included (default 5, ack only).
+  *            -S rate          Companion readings per second (default 500).
+  *            -L us            Companion main loop period (default 50).
+  *            -e n, -q n, -v n Send an enumeration, request or event packet
+  *                             every n frames instead of data (default 0,
+  *                             never).
+  *            -i n             Every n frames send a data packet with
+  *                             reserved header bits set instead, and
+  *                             check the companion rejects each one
+  *                             (default 0, never).
+  *            -l fraction      Chance of losing a packet, each direction.
+  *            -c fraction      Chance of flipping a bit in a packet, each
+  *                             direction.
+  *            -x seed          Random seed for the injected errors.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#include "wdc_codec.h"
+#include "wdc_comm.h"
+#include "wdc_crc.h"
+#include "wdc_datalink.h"
+#include "wdc_transport.h"
+#include "wdcloop_physical.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define EMU_DEFAULT_FRAMES      10000UL
+#define EMU_DEFAULT_POLL_HZ     1000UL
+#define EMU_DEFAULT_SAMPLE_HZ   500UL
+#define EMU_DEFAULT_LOOP_US     50UL
+#define EMU_ACK_ONLY_SIZE       (1 + WDC_TLL_HEADER_LEN)
+
+// Position of "dll rx_invalid" in the GET_STATS reply (see emu_stat_names).
+#define EMU_STAT_DLL_RX_INVALID 10
+
+// Frames to keep polling at the end of a run, for the statistics reply and
+// the last readings.
+#define EMU_STATS_FRAMES        200
+
+#define EMU_WINDOW_MASK         (WDC_TLL_WINDOW_SIZE - 1)
+
+typedef std::chrono::steady_clock emu_clock_t;
+
+/* Private Types ------------------------------------------------------------ */
+//
+// A segment sent by the base, kept until the companion acknowledges it.
+//
+typedef struct
+{
+  uint8_t               endpoint;
+  uint8_t               flags;
+  std::vector<uint8_t>  data;
+  unsigned long         sent_frame;
+} emu_segment_t;
+
+typedef struct
+{
+  uint8_t               endpoint;
+  std::vector<uint8_t>  data;
+} emu_message_t;
+
+/* Private Variables -------------------------------------------------------- */
+static std::mt19937 emu_rng;
+static double emu_loss = 0.0;
+static double emu_corrupt = 0.0;
+
+//
+// Base transport state. The receive side mirrors wdc_transport.c; the
+// send side resends anything not acknowledged within
+// WDC_TLL_RETRANSMIT_FRAMES.
+//
+static uint8_t emu_rx_next = 0;
+static uint8_t emu_rx_sack = 0;
+static bool emu_rx_held[WDC_TLL_WINDOW_SIZE];
+static emu_segment_t emu_rx_window[WDC_TLL_WINDOW_SIZE];
+static std::vector<uint8_t> emu_rx_message;
+static uint8_t emu_tx_una = 0;
+static uint8_t emu_tx_next = 0;
+static uint8_t emu_tx_acked = 0;
+static emu_segment_t emu_tx_window[WDC_TLL_WINDOW_SIZE];
+static std::deque<emu_message_t> emu_tx_queue;
+
+// Readings the companion accepted, oldest first, and when they were taken.
+static std::deque<int16_t> emu_expected;
+static std::deque<double> emu_taken_us;
+static std::vector<double> emu_latency_ms;
+static std::vector<uint16_t> emu_companion_stats;
+static bool emu_stats_received = false;
+static double emu_now_us = 0.0;
+
+// Counters.
+static unsigned long emu_sets = 0;
+static unsigned long emu_set_mismatches = 0;
+static unsigned long emu_payload_bytes = 0;
+static unsigned long emu_c2b_packets = 0;
+static unsigned long emu_c2b_data_frames = 0;
+static unsigned long emu_crc_errors = 0;
+static unsigned long emu_wrong_direction = 0;
+static unsigned long emu_duplicates = 0;
+static unsigned long emu_enum_replies = 0;
+static unsigned long emu_invalid_sent = 0;
+static unsigned long emu_retransmits = 0;
+static unsigned long emu_lost[2] = { 0, 0 };
+static unsigned long emu_corrupted[2] = { 0, 0 };
+
+static const char *emu_stat_names[] =
+{
+  "pll rx_overruns", "pll rx_parity_errors", "pll tx_waits", "pll rx_frames",
+  "pll rx_frames_dropped", "pll rx_empty_frames", "pll rx_flushes",
+  "dll rx_packets", "dll rx_crc_errors", "dll rx_wrong_direction",
+  "dll rx_invalid", "dll tx_packets", "dll tx_lane_full",
+  "tll tx_segments", "tll tx_retransmits", "tll rx_segments",
+  "tll rx_duplicates", "tll rx_dropped", "tll rx_messages",
+};
+
+/* Private Function Prototypes ---------------------------------------------- */
+static double EmuPercentile(std::vector<double> &samples, double pct);
+static void EmuSample(unsigned long index, int16_t *sample);
+static bool EmuDamage(std::vector<uint8_t> &packet, int dirn);
+static std::vector<uint8_t> EmuBuildPacket(unsigned long frame,
+                                           unsigned long size,
+                                           unsigned long enum_every,
+                                           unsigned long request_every,
+                                           unsigned long event_every,
+                                           unsigned long invalid_every);
+static std::vector<uint8_t> EmuBuildSegment(unsigned long frame,
+                                            unsigned long size);
+static void EmuReceivePacket(const uint8_t *packet, uint16_t len);
+static void EmuReceiveSegment(uint8_t endpoint, const uint8_t *payload,
+                              uint8_t len);
+static void EmuDeliver(uint8_t endpoint, const std::vector<uint8_t> &message);
+
+/* Function Definitions ----------------------------------------------------- */
+int main(int argc, char **argv)
+{
+  unsigned long frames = EMU_DEFAULT_FRAMES;
+  unsigned long poll_hz = EMU_DEFAULT_POLL_HZ;
+  unsigned long frame_size = EMU_ACK_ONLY_SIZE;
+  unsigned long sample_hz = EMU_DEFAULT_SAMPLE_HZ;
+  unsigned long loop_us = EMU_DEFAULT_LOOP_US;
+  unsigned long enum_every = 0;
+  unsigned long request_every = 0;
+  unsigned long event_every = 0;
+  unsigned long invalid_every = 0;
+  unsigned long seed = 1;
+  unsigned long samples_added = 0;
+  unsigned long samples_refused = 0;
+  double next_sample_us = 0.0;
+  double next_loop_us = 0.0;
+  double host_ns = 0.0;
+  uint8_t reply[WDC_LOOP_PIPE_SIZE];
+  int16_t sample[WDC_COMM_CHANNELS];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:s:S:L:e:q:v:i:l:c:x:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': frames = strtoul(optarg, NULL, 0); break;
+      case 'r': poll_hz = strtoul(optarg, NULL, 0); break;
+      case 's': frame_size = strtoul(optarg, NULL, 0); break;
+      case 'S': sample_hz = strtoul(optarg, NULL, 0); break;
+      case 'L': loop_us = strtoul(optarg, NULL, 0); break;
+      case 'e': enum_every = strtoul(optarg, NULL, 0); break;
+      case 'q': request_every = strtoul(optarg, NULL, 0); break;
+      case 'v': event_every = strtoul(optarg, NULL, 0); break;
+      case 'i': invalid_every = strtoul(optarg, NULL, 0); break;
+      case 'l': emu_loss = strtod(optarg, NULL); break;
+      case 'c': emu_corrupt = strtod(optarg, NULL); break;
+      case 'x': seed = strtoul(optarg, NULL, 0); break;
+      default: frames = 0; break;
+    }
+  }
+  if ((frames == 0) || (poll_hz == 0) || (loop_us == 0) ||
+      (frame_size < EMU_ACK_ONLY_SIZE) ||
+      (frame_size > WDC_DLL_DATA_PACKET_LEN))
+  {
+    fprintf(stderr, "usage: %s [-n frames] [-r poll Hz] [-s size %u-%u] "
+            "[-S sample Hz] [-L loop us] [-e n] [-q n] [-v n] [-i n] "
+            "[-l loss] [-c corrupt] [-x seed]\n",
+            argv[0], EMU_ACK_ONLY_SIZE, WDC_DLL_DATA_PACKET_LEN);
+    return 1;
+  }
+
+  emu_rng.seed(seed);
+  WDC_CommInit();
+
+  double frame_us = 1e6 / poll_hz;
+  double sample_us = sample_hz ? 1e6 / sample_hz : 0.0;
+  unsigned long total = frames + EMU_STATS_FRAMES;
+
+  for (unsigned long frame = 0; frame < total; frame++)
+  {
+    double frame_start_us = frame * frame_us;
+
+    //
+    // Run the companion's main loop up to the start of the frame, taking
+    // readings as they fall due.
+    //
+    emu_clock_t::time_point t0 = emu_clock_t::now();
+    while (next_loop_us <= frame_start_us)
+    {
+      emu_now_us = next_loop_us;
+      if (sample_hz && (frame < frames) && (next_sample_us <= emu_now_us))
+      {
+        EmuSample(samples_added + samples_refused, sample);
+        if (WDC_CommAddSample(sample, (uint32_t)(emu_now_us / 1000)))
+        {
+          emu_expected.insert(emu_expected.end(), sample,
+                              sample + WDC_COMM_CHANNELS);
+          emu_taken_us.push_back(emu_now_us);
+          samples_added++;
+        }
+        else
+        {
+          samples_refused++;
+        }
+        next_sample_us += sample_us;
+      }
+      WDC_CommTask((uint32_t)(emu_now_us / 1000));
+      next_loop_us += loop_us;
+    }
+    emu_now_us = frame_start_us;
+
+    //
+    // Ask for the companion's counters once the measured run is over.
+    //
+    if (frame == frames)
+    {
+      emu_message_t request;
+
+      request.endpoint = WDC_DLL_ENDPOINT_CONTROL;
+      request.data.push_back(WDC_COMM_CONTROL_GET_STATS);
+      emu_tx_queue.push_back(request);
+    }
+    else if ((frame > frames) && emu_stats_received && emu_taken_us.empty())
+    {
+      break;
+    }
+
+    //
+    // One bus frame: SOF, the base's packet, EOF, then the companion's.
+    //
+    std::vector<uint8_t> packet = EmuBuildPacket(frame, frame_size, enum_every,
+                                                 request_every, event_every,
+                                                 (frame < frames) ?
+                                                 invalid_every : 0);
+    WDC_LoopBaseStartFrame();
+    if (EmuDamage(packet, 0))
+    {
+      WDC_LoopBaseWrite(&packet[0], (uint16_t)packet.size());
+    }
+    WDC_LoopBaseEndFrame();
+    host_ns += std::chrono::duration<double, std::nano>(
+      emu_clock_t::now() - t0).count();
+
+    uint16_t len = WDC_LoopBaseRead(reply, sizeof(reply));
+    if (len > 0)
+    {
+      std::vector<uint8_t> c2b(reply, reply + len);
+
+      emu_c2b_packets++;
+      if (EmuDamage(c2b, 1))
+      {
+        EmuReceivePacket(&c2b[0], (uint16_t)c2b.size());
+      }
+    }
+  }
+
+  double secs = frames / (double)poll_hz;
+
+  printf("frames            : %lu at %lu Hz (%.2f s simulated)\n",
+         frames, poll_hz, secs);
+  printf("readings          : %lu taken, %lu refused by the companion\n",
+         samples_added + samples_refused, samples_refused);
+  printf("sets delivered    : %lu (%.0f/s), %lu mismatched\n",
+         emu_sets, emu_sets / secs, emu_set_mismatches);
+  printf("payload           : %.0f bytes/s, %lu of %lu companion packets "
+         "carried data\n", emu_payload_bytes / secs, emu_c2b_data_frames,
+         emu_c2b_packets);
+  if (!emu_latency_ms.empty())
+  {
+    printf("latency           : p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           EmuPercentile(emu_latency_ms, 50.0),
+           EmuPercentile(emu_latency_ms, 99.0),
+           EmuPercentile(emu_latency_ms, 100.0));
+  }
+  printf("injected          : lost %lu/%lu, corrupted %lu/%lu (to/from "
+         "companion)\n", emu_lost[0], emu_lost[1], emu_corrupted[0],
+         emu_corrupted[1]);
+  printf("base rx           : %lu crc errors, %lu wrong direction, "
+         "%lu duplicates\n", emu_crc_errors, emu_wrong_direction,
+         emu_duplicates);
+  printf("base tx           : %lu retransmits, %lu enumeration replies, "
+         "%lu invalid headers\n", emu_retransmits, emu_enum_replies,
+         emu_invalid_sent);
+  printf("host              : %.0f ns per frame\n", host_ns / frames);
+
+  if (!emu_stats_received)
+  {
+    printf("companion stats   : no reply\n");
+    return 0;
+  }
+  for (size_t i = 0; i < emu_companion_stats.size(); i++)
+  {
+    if (i < sizeof(emu_stat_names) / sizeof(emu_stat_names[0]))
+    {
+      printf("  %-22s: %u\n", emu_stat_names[i], emu_companion_stats[i]);
+    }
+    else
+    {
+      printf("  counter %-14u: %u\n", (unsigned)i, emu_companion_stats[i]);
+    }
+  }
+
+  //
+  // Without injected errors, every invalid header sent must have been
+  // rejected by the companion's data-link layer.
+  //
+  if ((emu_invalid_sent > 0) && (emu_loss == 0.0) && (emu_corrupt == 0.0) &&
+      (emu_companion_stats.size() > EMU_STAT_DLL_RX_INVALID) &&
+      (emu_companion_stats[EMU_STAT_DLL_RX_INVALID] != emu_invalid_sent))
+  {
+    printf("invalid headers   : %lu sent, %u rejected\n", emu_invalid_sent,
+           emu_companion_stats[EMU_STAT_DLL_RX_INVALID]);
+    return 2;
+  }
+
+  return 0;
+}
+
+/* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   Nearest-rank percentile of a sample set.
+ * @retval  Sample value at the requested percentile.
+ */
+static double EmuPercentile(std::vector<double> &samples, double pct)
+{
+  size_t rank = (size_t)(pct / 100.0 * (samples.size() - 1) + 0.5);
+
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
+/**
+ * @brief   Synthetic reading: a slow sine per channel plus a little noise.
+ * @retval  None.
+ */
+static void EmuSample(unsigned long index, int16_t *sample)
+{
+  for (int c = 0; c < WDC_COMM_CHANNELS; c++)
+  {
+    sample[c] = (int16_t)(500.0 * sin(index / 300.0 + c) +
+                          (long)(emu_rng() % 5));
+  }
+}
+
+/**
+ * @brief   Apply the injected errors to a packet on the wire.
+ * @param   dirn: 0 for base to companion, 1 for companion to base.
+ * @retval  False if the packet was lost.
+ */
+static bool EmuDamage(std::vector<uint8_t> &packet, int dirn)
+{
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+  if ((emu_loss > 0.0) && (chance(emu_rng) < emu_loss))
+  {
+    emu_lost[dirn]++;
+    return false;
+  }
+  if ((emu_corrupt > 0.0) && (chance(emu_rng) < emu_corrupt))
+  {
+    size_t bit = emu_rng() % (packet.size() * 8);
+
+    packet[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    emu_corrupted[dirn]++;
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Build the base's packet for a frame, with its CRC trailer.
+ * @retval  The packet.
+ */
+static std::vector<uint8_t> EmuBuildPacket(unsigned long frame,
+                                           unsigned long size,
+                                           unsigned long enum_every,
+                                           unsigned long request_every,
+                                           unsigned long event_every,
+                                           unsigned long invalid_every)
+{
+  std::vector<uint8_t> packet;
+
+  if (enum_every && ((frame % enum_every) == enum_every - 1))
+  {
+    packet.push_back(WDC_DLLHeaderEncode(WDC_DLL_DIRN_B2C,
+                                         WDC_DLL_PACKET_TYPE_ENUMERATION,
+                                         WDC_DLL_ENDPOINT_CONTROL));
+    packet.push_back(WDC_DLL_ENUM_GET_BAUD);
+  }
+  else if (request_every && ((frame % request_every) == request_every - 1))
+  {
+    packet.push_back(WDC_DLLHeaderEncode(WDC_DLL_DIRN_B2C,
+                                         WDC_DLL_PACKET_TYPE_REQUEST,
+                                         WDC_DLL_ENDPOINT_OUTPUT));
+    packet.resize(WDC_DLL_REQUEST_PACKET_LEN, (uint8_t)frame);
+  }
+  else if (invalid_every && ((frame % invalid_every) == invalid_every - 1))
+  {
+    //
+    // A transport acknowledgement of nothing, which would wreck the
+    // companion's transmit window if it got through. Cycles through every
+    // reserved bit pattern.
+    //
+    packet.push_back((uint8_t)(WDC_DLLHeaderEncode(WDC_DLL_DIRN_B2C,
+                                                   WDC_DLL_PACKET_TYPE_DATA,
+                                                   WDC_DLL_ENDPOINT_OUTPUT) |
+                               ((emu_invalid_sent % 7 + 1) << 4)));
+    packet.resize(1 + WDC_TLL_HEADER_LEN, 0);
+    emu_invalid_sent++;
+  }
+  else if (event_every && ((frame % event_every) == event_every - 1))
+  {
+    packet.push_back(WDC_DLLHeaderEncode(WDC_DLL_DIRN_B2C,
+                                         WDC_DLL_PACKET_TYPE_EVENT,
+                                         WDC_DLL_ENDPOINT_OUTPUT));
+    packet.resize(size, (uint8_t)frame);
+  }
+  else
+  {
+    packet = EmuBuildSegment(frame, size);
+  }
+
+#if (WDC_DLL_CRC == 8)
+  packet.push_back(WDC_CRC8(WDC_CRC8_INIT, &packet[0], (uint16_t)packet.size()));
+#elif (WDC_DLL_CRC == 16)
+  uint16_t crc = WDC_CRC16(WDC_CRC16_INIT, &packet[0], (uint16_t)packet.size());
+
+  packet.push_back((uint8_t)(crc >> 8));
+  packet.push_back((uint8_t)crc);
+#endif
+
+  return packet;
+}
+
+/**
+ * @brief   Build a transport data packet. Queued messages go first, then
+ *          filler segments on the output endpoint up to the packet size;
+ *          a size of EMU_ACK_ONLY_SIZE only acknowledges.
+ * @retval  The packet, without the CRC trailer.
+ */
+static std::vector<uint8_t> EmuBuildSegment(unsigned long frame,
+                                            unsigned long size)
+{
+  std::vector<uint8_t> packet;
+  emu_segment_t *segment = NULL;
+  uint8_t seq = emu_tx_next;
+  uint8_t endpoint = WDC_DLL_ENDPOINT_CONTROL;
+
+  //
+  // Resend the oldest segment not acknowledged in time.
+  //
+  for (uint8_t s = emu_tx_una; s != emu_tx_next; s++)
+  {
+    emu_segment_t *sent = &emu_tx_window[s & EMU_WINDOW_MASK];
+
+    if (!(emu_tx_acked & (1 << (s & EMU_WINDOW_MASK))) &&
+        ((frame - sent->sent_frame) >= WDC_TLL_RETRANSMIT_FRAMES))
+    {
+      segment = sent;
+      seq = s;
+      emu_retransmits++;
+      break;
+    }
+  }
+
+  //
+  // Otherwise start a new one if the window has room.
+  //
+  if ((segment == NULL) &&
+      ((uint8_t)(emu_tx_next - emu_tx_una) < WDC_TLL_WINDOW_SIZE) &&
+      (!emu_tx_queue.empty() || (size > EMU_ACK_ONLY_SIZE)))
+  {
+    segment = &emu_tx_window[emu_tx_next & EMU_WINDOW_MASK];
+    segment->flags = bmWDC_TLL_HEADER_FIRST | bmWDC_TLL_HEADER_LAST;
+    if (!emu_tx_queue.empty())
+    {
+      segment->endpoint = emu_tx_queue.front().endpoint;
+      segment->data = emu_tx_queue.front().data;
+      emu_tx_queue.pop_front();
+    }
+    else
+    {
+      segment->endpoint = WDC_DLL_ENDPOINT_OUTPUT;
+      segment->data.assign(size - EMU_ACK_ONLY_SIZE, (uint8_t)frame);
+    }
+    emu_tx_acked &= ~(1 << (emu_tx_next & EMU_WINDOW_MASK));
+    emu_tx_next++;
+  }
+
+  if (segment != NULL)
+  {
+    segment->sent_frame = frame;
+    endpoint = segment->endpoint;
+  }
+
+  packet.push_back(WDC_DLLHeaderEncode(WDC_DLL_DIRN_B2C,
+                                       WDC_DLL_PACKET_TYPE_DATA, endpoint));
+  packet.push_back(segment ? segment->flags : 0);
+  packet.push_back(seq);
+  packet.push_back(emu_rx_next);
+  packet.push_back(emu_rx_sack);
+  if (segment != NULL)
+  {
+    packet.insert(packet.end(), segment->data.begin(), segment->data.end());
+  }
+
+  return packet;
+}
+
+/**
+ * @brief   Handle a packet from the companion.
+ * @retval  None.
+ */
+static void EmuReceivePacket(const uint8_t *packet, uint16_t len)
+{
+#if (WDC_DLL_CRC == 8)
+  if ((len <= WDC_DLL_CRC_LEN) || (WDC_CRC8(WDC_CRC8_INIT, packet, len) != 0))
+  {
+    emu_crc_errors++;
+    return;
+  }
+#elif (WDC_DLL_CRC == 16)
+  if ((len <= WDC_DLL_CRC_LEN) || (WDC_CRC16(WDC_CRC16_INIT, packet, len) != 0))
+  {
+    emu_crc_errors++;
+    return;
+  }
+#endif
+  len -= WDC_DLL_CRC_LEN;
+
+  uint8_t header = packet[WDC_DLL_HEADER_IDX];
+
+  if (WDC_DLLHeaderIsB2C(header))
+  {
+    emu_wrong_direction++;
+    return;
+  }
+
+  switch (WDC_DLLHeaderPacketType(header))
+  {
+    case WDC_DLL_PACKET_TYPE_ENUMERATION:
+      emu_enum_replies++;
+      break;
+
+    case WDC_DLL_PACKET_TYPE_DATA:
+      EmuReceiveSegment(WDC_DLLHeaderEndpoint(header), &packet[1],
+                        (uint8_t)(len - 1));
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief   Handle a transport segment from the companion: take its
+ *          acknowledgement, then hold or deliver its data.
+ * @retval  None.
+ */
+static void EmuReceiveSegment(uint8_t endpoint, const uint8_t *payload,
+                              uint8_t len)
+{
+  if (len < WDC_TLL_HEADER_LEN)
+  {
+    return;
+  }
+
+  //
+  // The companion's acknowledgement of the base's segments.
+  //
+  uint8_t ack = payload[WDC_TLL_HEADER_ACK_IDX];
+  uint8_t sack = payload[WDC_TLL_HEADER_SACK_IDX];
+  uint8_t inflight = (uint8_t)(emu_tx_next - emu_tx_una);
+
+  if ((uint8_t)(ack - emu_tx_una) <= inflight)
+  {
+    for (uint8_t s = emu_tx_una; s != ack; s++)
+    {
+      emu_tx_acked |= 1 << (s & EMU_WINDOW_MASK);
+    }
+    for (uint8_t i = 0; i < WDC_TLL_WINDOW_SIZE; i++)
+    {
+      uint8_t s = (uint8_t)(ack + 1 + i);
+      if ((sack & (1 << i)) && ((uint8_t)(s - emu_tx_una) < inflight))
+      {
+        emu_tx_acked |= 1 << (s & EMU_WINDOW_MASK);
+      }
+    }
+    while ((emu_tx_una != emu_tx_next) &&
+           (emu_tx_acked & (1 << (emu_tx_una & EMU_WINDOW_MASK))))
+    {
+      emu_tx_acked &= ~(1 << (emu_tx_una & EMU_WINDOW_MASK));
+      emu_tx_una++;
+    }
+  }
+
+  if (len == WDC_TLL_HEADER_LEN)
+  {
+    return;
+  }
+  emu_c2b_data_frames++;
+
+  //
+  // Hold the segment in its window slot, then deliver in order.
+  //
+  uint8_t seq = payload[WDC_TLL_HEADER_SEQ_IDX];
+  uint8_t offset = (uint8_t)(seq - emu_rx_next);
+
+  if ((offset >= WDC_TLL_WINDOW_SIZE) ||
+      emu_rx_held[seq & EMU_WINDOW_MASK])
+  {
+    emu_duplicates++;
+    return;
+  }
+
+  emu_segment_t *segment = &emu_rx_window[seq & EMU_WINDOW_MASK];
+  segment->endpoint = endpoint;
+  segment->flags = payload[WDC_TLL_HEADER_FLAGS_IDX];
+  segment->data.assign(&payload[WDC_TLL_HEADER_LEN], &payload[len]);
+  emu_rx_held[seq & EMU_WINDOW_MASK] = true;
+
+  while (emu_rx_held[emu_rx_next & EMU_WINDOW_MASK])
+  {
+    segment = &emu_rx_window[emu_rx_next & EMU_WINDOW_MASK];
+    emu_rx_held[emu_rx_next & EMU_WINDOW_MASK] = false;
+    emu_rx_next++;
+
+    if (segment->flags & bmWDC_TLL_HEADER_FIRST)
+    {
+      emu_rx_message.clear();
+    }
+    emu_rx_message.insert(emu_rx_message.end(), segment->data.begin(),
+                          segment->data.end());
+    if (segment->flags & bmWDC_TLL_HEADER_LAST)
+    {
+      EmuDeliver(segment->endpoint, emu_rx_message);
+    }
+  }
+
+  emu_rx_sack = 0;
+  for (uint8_t i = 0; i < WDC_TLL_WINDOW_SIZE - 1; i++)
+  {
+    if (emu_rx_held[(emu_rx_next + 1 + i) & EMU_WINDOW_MASK])
+    {
+      emu_rx_sack |= 1 << i;
+    }
+  }
+}
+
+/**
+ * @brief   Handle a complete message from the companion.
+ * @retval  None.
+ */
+static void EmuDeliver(uint8_t endpoint, const std::vector<uint8_t> &message)
+{
+  int16_t decoded[256 * WDC_CODEC_MAX_CHANNELS];
+  uint8_t channels = 0;
+
+  if (message.empty())
+  {
+    return;
+  }
+
+  if (endpoint == WDC_DLL_ENDPOINT_CONTROL)
+  {
+    if ((message[0] == WDC_COMM_CONTROL_GET_STATS) && (message.size() >= 2))
+    {
+      emu_companion_stats.clear();
+      for (size_t i = 0; (i < message[1]) && (3 + 2 * i < message.size()); i++)
+      {
+        emu_companion_stats.push_back(
+          (uint16_t)((message[2 + 2 * i] << 8) | message[3 + 2 * i]));
+      }
+      emu_stats_received = true;
+    }
+    return;
+  }
+
+  //
+  // A batch of readings. Each set is checked against what the companion
+  // was given and timed from when it was taken.
+  //
+  uint8_t sets = WDC_CodecDecode(&message[0], (uint8_t)message.size(),
+                                 decoded, 255, &channels);
+  emu_payload_bytes += message.size();
+
+  if ((sets == 0) || (channels != WDC_COMM_CHANNELS))
+  {
+    emu_set_mismatches++;
+    return;
+  }
+
+  //
+  // Delivery is in order, so the batch normally starts at the oldest
+  // reading outstanding. After a damaged batch, find where this one
+  // starts and count the readings skipped over as mismatched.
+  //
+  size_t start = 0;
+  size_t outstanding = emu_taken_us.size();
+
+  while ((start < outstanding) &&
+         !std::equal(decoded, decoded + channels,
+                     emu_expected.begin() + start * channels))
+  {
+    start++;
+  }
+  if (start == outstanding)
+  {
+    emu_set_mismatches += sets;
+    return;
+  }
+  emu_set_mismatches += start;
+  emu_taken_us.erase(emu_taken_us.begin(), emu_taken_us.begin() + start);
+  emu_expected.erase(emu_expected.begin(),
+                     emu_expected.begin() + start * channels);
+
+  for (uint8_t s = 0; (s < sets) && !emu_taken_us.empty(); s++)
+  {
+    if (std::equal(&decoded[s * channels], &decoded[(s + 1) * channels],
+                   emu_expected.begin()))
+    {
+      emu_latency_ms.push_back((emu_now_us - emu_taken_us.front()) / 1000.0);
+      emu_sets++;
+    }
+    else
+    {
+      emu_set_mismatches++;
+    }
+    emu_taken_us.pop_front();
+    emu_expected.erase(emu_expected.begin(),
+                       emu_expected.begin() + WDC_COMM_CHANNELS);
+  }
+}
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
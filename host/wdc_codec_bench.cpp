@@ -0,0 +1,154 @@
+/**
+  ******************************************************************************
+  * @file    wdc_codec_bench.cpp
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Host tool for the sensor payload codec in wdc_codec.c. Encodes a
+  *          synthetic slowly changing signal into data packet payloads,
+  *          decodes it again, and reports how many sample sets each payload
+  *          holds compared with raw 16-bit samples.
+  *
+  *          See README.md for how to build the host tools.
+  *
+  *          Usage: wdc_codec_bench [sets] [channels] [noise] [width]
+  *                 width 0 selects varints (the default), 1-16 bit-packing.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "wdc_codec.h"
+#include "wdc_datalink.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define BENCH_DEFAULT_SETS      100000UL
+#define BENCH_DEFAULT_CHANNELS  3
+#define BENCH_DEFAULT_NOISE     4
+#define BENCH_PAYLOAD_LEN       (WDC_DLL_DATA_PACKET_LEN - 1)
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+/* Function Definitions ----------------------------------------------------- */
+int main(int argc, char **argv)
+{
+  unsigned long sets = BENCH_DEFAULT_SETS;
+  unsigned long channels = BENCH_DEFAULT_CHANNELS;
+  unsigned long noise = BENCH_DEFAULT_NOISE;
+  unsigned long width = 0;
+  std::vector<int16_t> input;
+  std::vector<int16_t> output;
+  std::vector<std::vector<uint8_t> > payloads;
+  uint8_t buffer[BENCH_PAYLOAD_LEN];
+  int16_t decoded[256 * WDC_CODEC_MAX_CHANNELS];
+  wdc_codec_encoder_t enc;
+
+  if (argc > 1)
+  {
+    sets = strtoul(argv[1], NULL, 0);
+  }
+  if (argc > 2)
+  {
+    channels = strtoul(argv[2], NULL, 0);
+  }
+  if (argc > 3)
+  {
+    noise = strtoul(argv[3], NULL, 0);
+  }
+  if (argc > 4)
+  {
+    width = strtoul(argv[4], NULL, 0);
+  }
+  if ((sets == 0) || (channels == 0) || (channels > WDC_CODEC_MAX_CHANNELS) ||
+      (width > 16))
+  {
+    fprintf(stderr, "usage: %s [sets] [channels 1-%u] [noise] [width 0-16]\n",
+            argv[0], WDC_CODEC_MAX_CHANNELS);
+    return 1;
+  }
+
+  //
+  // A slow sine per channel plus a little noise, like an accelerometer at
+  // rest with a 1 g offset on one axis.
+  //
+  srand(1);
+  input.resize(sets * channels);
+  for (unsigned long s = 0; s < sets; s++)
+  {
+    for (unsigned long c = 0; c < channels; c++)
+    {
+      double v = 1000.0 * sin(s / 200.0 + c) + ((c == 2) ? 16384.0 : 0.0);
+      if (noise > 0)
+      {
+        v += (long)(rand() % (2 * noise + 1)) - (long)noise;
+      }
+      input[s * channels + c] = (int16_t)v;
+    }
+  }
+
+  //
+  // Encode into payloads, starting a new one whenever a set does not fit.
+  //
+  bench_clock_t::time_point start = bench_clock_t::now();
+  WDC_CodecEncoderInit(&enc, buffer, sizeof(buffer), (uint8_t)channels,
+                       (uint8_t)width);
+  for (unsigned long s = 0; s < sets; s++)
+  {
+    if (!WDC_CodecEncodeSample(&enc, &input[s * channels]))
+    {
+      payloads.push_back(std::vector<uint8_t>(buffer, buffer + enc.len));
+      WDC_CodecEncoderReset(&enc);
+      WDC_CodecEncodeSample(&enc, &input[s * channels]);
+    }
+  }
+  payloads.push_back(std::vector<uint8_t>(buffer, buffer + enc.len));
+  double encode_secs = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+
+  //
+  // Decode and compare.
+  //
+  start = bench_clock_t::now();
+  for (size_t p = 0; p < payloads.size(); p++)
+  {
+    uint8_t n = WDC_CodecDecode(&payloads[p][0], (uint8_t)payloads[p].size(),
+                                decoded, 255, NULL);
+    output.insert(output.end(), decoded, decoded + n * channels);
+  }
+  double decode_secs = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+
+  if (output != input)
+  {
+    fprintf(stderr, "decoded samples do not match the input\n");
+    return 1;
+  }
+
+  double per_payload = (double)sets / payloads.size();
+  double raw_per_payload = (double)(BENCH_PAYLOAD_LEN / (2 * channels));
+
+  printf("sets            : %lu x %lu channels, noise +/-%lu\n", sets, channels, noise);
+  printf("codec           : %s\n", (width == 0) ? "delta varint" : "delta bit-packed");
+  printf("payloads        : %lu of %u bytes\n", (unsigned long)payloads.size(),
+         (unsigned)BENCH_PAYLOAD_LEN);
+  printf("sets/payload    : %.1f (raw 16-bit: %.0f, %.2fx)\n", per_payload,
+         raw_per_payload, per_payload / raw_per_payload);
+  printf("encode          : %.1f M sets/s\n", sets / encode_secs / 1e6);
+  printf("decode          : %.1f M sets/s\n", sets / decode_secs / 1e6);
+
+  return 0;
+}
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,132 @@
+/**
+  ******************************************************************************
+  * @file    wdc_crc_bench.cpp
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    15-Sep-2014
+  * @brief   Host benchmark that compares the table-driven and bitwise CRC
+  *          routines in wdc_crc.c and checks that they agree.
+  *
+  *          See README.md for how to build the host tools.
+  *
+  *          Usage: wdc_crc_bench [frames] [frame size]
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "wdc_crc.h"
+#include "wdc_datalink.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define BENCH_DEFAULT_FRAMES    1000000UL
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+/* Private Function Definitions --------------------------------------------- */
+//
+// Run one CRC routine over every frame and print its throughput. The
+// results are summed so the compiler cannot drop the loop.
+//
+template <typename crc_t>
+static unsigned long BenchRun(const char *name,
+                              crc_t (*crc)(crc_t, const uint8_t *, uint16_t),
+                              crc_t init, const std::vector<uint8_t> &data,
+                              unsigned long frames, unsigned long frame_size)
+{
+  unsigned long sum = 0;
+  bench_clock_t::time_point start = bench_clock_t::now();
+
+  for (unsigned long i = 0; i < frames; i++)
+  {
+    sum += crc(init, &data[(i * frame_size) % (data.size() - frame_size)],
+               (uint16_t)frame_size);
+  }
+
+  double secs = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+  printf("%-16s %10.1f MB/s %12.0f frames/s\n", name,
+         (frames * frame_size) / secs / 1e6, frames / secs);
+
+  return sum;
+}
+
+/* Function Definitions ----------------------------------------------------- */
+int main(int argc, char **argv)
+{
+  unsigned long frames = BENCH_DEFAULT_FRAMES;
+  unsigned long frame_size = WDC_DLL_MAX_FRAME_SIZE;
+  std::vector<uint8_t> data(4096);
+  static const uint8_t check[] = "123456789";
+
+  if (argc > 1)
+  {
+    frames = strtoul(argv[1], NULL, 0);
+  }
+  if (argc > 2)
+  {
+    frame_size = strtoul(argv[2], NULL, 0);
+  }
+  if ((frames == 0) || (frame_size == 0) || (frame_size >= data.size()))
+  {
+    fprintf(stderr, "usage: %s [frames] [frame size < %u]\n", argv[0],
+            (unsigned)data.size());
+    return 1;
+  }
+
+  srand(1);
+  for (size_t i = 0; i < data.size(); i++)
+  {
+    data[i] = (uint8_t)rand();
+  }
+
+  //
+  // Check against the published check values, then make sure both
+  // versions agree on every frame length.
+  //
+  if ((WDC_CRC8(WDC_CRC8_INIT, check, 9) != 0xF4) ||
+      (WDC_CRC16(WDC_CRC16_INIT, check, 9) != 0x29B1))
+  {
+    fprintf(stderr, "CRC check value mismatch\n");
+    return 1;
+  }
+  for (uint16_t len = 0; len <= 256; len++)
+  {
+    if ((WDC_CRC8(WDC_CRC8_INIT, &data[0], len) !=
+         WDC_CRC8Bitwise(WDC_CRC8_INIT, &data[0], len)) ||
+        (WDC_CRC16(WDC_CRC16_INIT, &data[0], len) !=
+         WDC_CRC16Bitwise(WDC_CRC16_INIT, &data[0], len)))
+    {
+      fprintf(stderr, "table and bitwise CRC disagree at length %u\n", len);
+      return 1;
+    }
+  }
+
+  printf("%lu frames of %lu bytes\n", frames, frame_size);
+  unsigned long sum = 0;
+  sum += BenchRun<uint8_t>("crc8 bitwise", WDC_CRC8Bitwise, WDC_CRC8_INIT,
+                           data, frames, frame_size);
+  sum += BenchRun<uint8_t>("crc8 table", WDC_CRC8, WDC_CRC8_INIT,
+                           data, frames, frame_size);
+  sum += BenchRun<uint16_t>("crc16 bitwise", WDC_CRC16Bitwise, WDC_CRC16_INIT,
+                            data, frames, frame_size);
+  sum += BenchRun<uint16_t>("crc16 table", WDC_CRC16, WDC_CRC16_INIT,
+                            data, frames, frame_size);
+  printf("(checksum %lu)\n", sum);
+
+  return 0;
+}
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,509 @@
+/**
+  ******************************************************************************
+  * @file    wdc_hub_sim.cpp
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Host simulator of a base hub polling many companions.
+  *
+  *          Every companion is a complete, independent copy of the stack
+  *          (wdc_comm.c down to the loopback PHY) on its own simulated bus.
+  *          A pool of worker threads steps the companions, each worker
+  *          running an event loop over its share of them.
+  *
+  *          The stack does depend on global state: every layer keeps its
+  *          state in file-scope variables, as there is one of it per
+  *          microcontroller, and cannot run twice in one image. The
+  *          simulator works around that rather than testing it. Each
+  *          companion gets its own copy of the shared library built from
+  *          src/WDC_Sensor, one dlopen() of a private file per companion,
+  *          so companions never share stack state.
+  *
+  *          Each companion tags its readings with its own number and a
+  *          running count, and the hub checks every set it decodes. Bad
+  *          sets are readings lost, repeated or delivered out of order on
+  *          a companion's own link.
+  *
+  *          Reports the aggregate bus frames per second and the CPU time
+  *          each companion costs, as a scaling benchmark for the base side.
+  *
+  *          See README.md for how to build the host tools.
+  *
+  *          Usage: wdc_hub_sim [options]
+  *            -c count         Companions (default 100).
+  *            -t threads       Worker threads (default: one per CPU).
+  *            -n frames        Bus frames per companion (default 2000).
+  *            -r rate          Poll rate, frames per second (default 1000).
+  *            -S rate          Readings per second per companion
+  *                             (default 500).
+  *            -L us            Companion main loop period (default 100).
+  *            -l library       Companion stack (default
+  *                             ./libwdc_companion.so).
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wdc_codec.h"
+#include "wdc_comm.h"
+#include "wdc_crc.h"
+#include "wdc_datalink.h"
+#include "wdc_transport.h"
+#include "wdcloop_physical.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define HUB_DEFAULT_COMPANIONS  100UL
+#define HUB_DEFAULT_FRAMES      2000UL
+#define HUB_DEFAULT_POLL_HZ     1000UL
+#define HUB_DEFAULT_SAMPLE_HZ   500UL
+#define HUB_DEFAULT_LOOP_US     100UL
+#define HUB_DEFAULT_LIBRARY     "./libwdc_companion.so"
+
+typedef std::chrono::steady_clock hub_clock_t;
+
+/* Private Types ------------------------------------------------------------ */
+//
+// One companion: its private copy of the stack and the hub's view of it.
+//
+typedef struct
+{
+  void          *handle;
+  void          (*comm_init)(void);
+  void          (*comm_task)(uint32_t now);
+  bool          (*comm_add_sample)(const int16_t *sample, uint32_t now);
+  void          (*base_start_frame)(void);
+  uint16_t      (*base_write)(const uint8_t *data, uint16_t len);
+  void          (*base_end_frame)(void);
+  uint16_t      (*base_read)(uint8_t *data, uint16_t len);
+  uint8_t       (*codec_decode)(const uint8_t *payload, uint8_t len,
+                                int16_t *samples, uint8_t max_sets,
+                                uint8_t *channels);
+#if (WDC_DLL_CRC == 8)
+  uint8_t       (*crc)(uint8_t crc, const uint8_t *data, uint16_t len);
+#elif (WDC_DLL_CRC == 16)
+  uint16_t      (*crc)(uint16_t crc, const uint8_t *data, uint16_t len);
+#endif
+
+  int16_t       id;
+  uint8_t       rx_next;
+  uint16_t      next_count;
+  double        next_sample_us;
+  double        next_loop_us;
+  unsigned long readings;
+  unsigned long refused;
+  unsigned long sets;
+  unsigned long bad_sets;
+  unsigned long bytes;
+} hub_companion_t;
+
+typedef struct
+{
+  unsigned long frames;
+  double        frame_us;
+  double        sample_us;
+  double        loop_us;
+} hub_config_t;
+
+/* Private Function Prototypes ---------------------------------------------- */
+static bool HubLoad(hub_companion_t *c, const char *library, const char *dir,
+                    unsigned long index);
+static void HubWorker(std::vector<hub_companion_t> *companions, size_t first,
+                      size_t step, const hub_config_t *config,
+                      double *cpu_secs);
+static void HubFrame(hub_companion_t *c, unsigned long frame,
+                     const hub_config_t *config);
+static void HubReceive(hub_companion_t *c, const uint8_t *packet, uint16_t len);
+static double HubThreadCpuSecs(void);
+
+/* Function Definitions ----------------------------------------------------- */
+int main(int argc, char **argv)
+{
+  unsigned long count = HUB_DEFAULT_COMPANIONS;
+  unsigned long threads = std::thread::hardware_concurrency();
+  unsigned long poll_hz = HUB_DEFAULT_POLL_HZ;
+  unsigned long sample_hz = HUB_DEFAULT_SAMPLE_HZ;
+  unsigned long loop_us = HUB_DEFAULT_LOOP_US;
+  const char *library = HUB_DEFAULT_LIBRARY;
+  hub_config_t config;
+  char dir[] = "/tmp/wdc_hub_XXXXXX";
+  int opt;
+
+  config.frames = HUB_DEFAULT_FRAMES;
+  while ((opt = getopt(argc, argv, "c:t:n:r:S:L:l:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'c': count = strtoul(optarg, NULL, 0); break;
+      case 't': threads = strtoul(optarg, NULL, 0); break;
+      case 'n': config.frames = strtoul(optarg, NULL, 0); break;
+      case 'r': poll_hz = strtoul(optarg, NULL, 0); break;
+      case 'S': sample_hz = strtoul(optarg, NULL, 0); break;
+      case 'L': loop_us = strtoul(optarg, NULL, 0); break;
+      case 'l': library = optarg; break;
+      default: count = 0; break;
+    }
+  }
+  if (threads == 0)
+  {
+    threads = 1;
+  }
+  if ((count == 0) || (count > 32767) || (config.frames == 0) ||
+      (poll_hz == 0) || (loop_us == 0))
+  {
+    fprintf(stderr, "usage: %s [-c companions] [-t threads] [-n frames] "
+            "[-r poll Hz] [-S sample Hz] [-L loop us] [-l library]\n",
+            argv[0]);
+    return 1;
+  }
+  threads = std::min(threads, count);
+  config.frame_us = 1e6 / poll_hz;
+  config.sample_us = sample_hz ? 1e6 / sample_hz : 0.0;
+  config.loop_us = (double)loop_us;
+
+  //
+  // Load one private copy of the stack per companion. dlopen() hands back
+  // the already loaded object for a path it has seen, so every copy gets
+  // its own file, removed again once it is mapped.
+  //
+  if (mkdtemp(dir) == NULL)
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  std::vector<hub_companion_t> companions(count);
+  hub_clock_t::time_point load_start = hub_clock_t::now();
+
+  for (unsigned long i = 0; i < count; i++)
+  {
+    if (!HubLoad(&companions[i], library, dir, i))
+    {
+      rmdir(dir);
+      return 1;
+    }
+  }
+  rmdir(dir);
+
+  double load_secs = std::chrono::duration<double>(
+    hub_clock_t::now() - load_start).count();
+
+  //
+  // Worker w takes companions w, w + threads, w + 2 * threads, ...
+  //
+  std::vector<std::thread> workers;
+  std::vector<double> cpu_secs(threads, 0.0);
+  hub_clock_t::time_point start = hub_clock_t::now();
+
+  for (unsigned long w = 0; w < threads; w++)
+  {
+    workers.push_back(std::thread(HubWorker, &companions, (size_t)w,
+                                  (size_t)threads, &config, &cpu_secs[w]));
+  }
+  for (size_t w = 0; w < workers.size(); w++)
+  {
+    workers[w].join();
+  }
+
+  double wall = std::chrono::duration<double>(hub_clock_t::now() - start).count();
+  double cpu = 0.0;
+  unsigned long readings = 0;
+  unsigned long refused = 0;
+  unsigned long sets = 0;
+  unsigned long bad_sets = 0;
+  unsigned long bytes = 0;
+  unsigned long min_sets = (unsigned long)-1;
+  unsigned long max_sets = 0;
+
+  for (size_t w = 0; w < cpu_secs.size(); w++)
+  {
+    cpu += cpu_secs[w];
+  }
+  for (size_t i = 0; i < companions.size(); i++)
+  {
+    readings += companions[i].readings;
+    refused += companions[i].refused;
+    sets += companions[i].sets;
+    bad_sets += companions[i].bad_sets;
+    bytes += companions[i].bytes;
+    min_sets = std::min(min_sets, companions[i].sets);
+    max_sets = std::max(max_sets, companions[i].sets);
+  }
+
+  double frames = (double)count * config.frames;
+  double sim_secs = config.frames / (double)poll_hz;
+
+  printf("companions        : %lu on %lu threads (%.3f s to load)\n",
+         count, threads, load_secs);
+  printf("frames            : %lu each at %lu Hz (%.2f s simulated)\n",
+         config.frames, poll_hz, sim_secs);
+  printf("elapsed           : %.3f s wall, %.3f s CPU\n", wall, cpu);
+  printf("frames/sec        : %.0f aggregate, %.1fx real time\n",
+         frames / wall, sim_secs / wall);
+  printf("CPU per companion : %.2f us per frame, %.2f%% of a core at %lu Hz\n",
+         cpu / frames * 1e6, cpu / count / sim_secs * 100.0, poll_hz);
+  printf("readings          : %lu taken, %lu refused\n", readings, refused);
+  printf("sets delivered    : %lu (%lu to %lu per companion), %lu bad\n",
+         sets, min_sets, max_sets, bad_sets);
+  printf("payload           : %lu bytes\n", bytes);
+
+  for (size_t i = 0; i < companions.size(); i++)
+  {
+    dlclose(companions[i].handle);
+  }
+
+  return (bad_sets == 0) ? 0 : 2;
+}
+
+/* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   Load a private copy of the stack for one companion and
+ *          initialize it.
+ * @retval  False if the library could not be copied, loaded or resolved.
+ */
+static bool HubLoad(hub_companion_t *c, const char *library, const char *dir,
+                    unsigned long index)
+{
+  std::string path = std::string(dir) + "/wdc_companion_" +
+                     std::to_string(index) + ".so";
+  FILE *in = fopen(library, "rb");
+  FILE *out = fopen(path.c_str(), "wb");
+  char buffer[65536];
+  size_t n;
+
+  if ((in == NULL) || (out == NULL))
+  {
+    fprintf(stderr, "cannot copy %s to %s\n", library, path.c_str());
+    if (in) fclose(in);
+    if (out) fclose(out);
+    return false;
+  }
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+  {
+    fwrite(buffer, 1, n, out);
+  }
+  fclose(in);
+  fclose(out);
+
+  c->handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  unlink(path.c_str());
+  if (c->handle == NULL)
+  {
+    fprintf(stderr, "%s\n", dlerror());
+    return false;
+  }
+
+  //
+  // Resolve the entry points this copy is driven through.
+  //
+  bool ok = true;
+#define HUB_RESOLVE(field, symbol) \
+  ok = ((*(void **)&c->field = dlsym(c->handle, symbol)) != NULL) && ok
+
+  HUB_RESOLVE(comm_init, "WDC_CommInit");
+  HUB_RESOLVE(comm_task, "WDC_CommTask");
+  HUB_RESOLVE(comm_add_sample, "WDC_CommAddSample");
+  HUB_RESOLVE(base_start_frame, "WDC_LoopBaseStartFrame");
+  HUB_RESOLVE(base_write, "WDC_LoopBaseWrite");
+  HUB_RESOLVE(base_end_frame, "WDC_LoopBaseEndFrame");
+  HUB_RESOLVE(base_read, "WDC_LoopBaseRead");
+  HUB_RESOLVE(codec_decode, "WDC_CodecDecode");
+#if (WDC_DLL_CRC == 8)
+  HUB_RESOLVE(crc, "WDC_CRC8");
+#elif (WDC_DLL_CRC == 16)
+  HUB_RESOLVE(crc, "WDC_CRC16");
+#endif
+#undef HUB_RESOLVE
+
+  if (!ok)
+  {
+    fprintf(stderr, "%s is not a loopback build of the companion stack\n",
+            library);
+    return false;
+  }
+
+  c->id = (int16_t)index;
+  c->rx_next = 0;
+  c->next_count = 0;
+  c->next_sample_us = 0.0;
+  c->next_loop_us = 0.0;
+  c->readings = 0;
+  c->refused = 0;
+  c->sets = 0;
+  c->bad_sets = 0;
+  c->bytes = 0;
+  c->comm_init();
+
+  return true;
+}
+
+/**
+ * @brief   Worker thread: run every frame for its share of the companions.
+ * @param   first: Index of the worker's first companion.
+ * @param   step: Distance between the worker's companions.
+ * @param   cpu_secs: Set to the CPU time the worker used.
+ * @retval  None.
+ */
+static void HubWorker(std::vector<hub_companion_t> *companions, size_t first,
+                      size_t step, const hub_config_t *config,
+                      double *cpu_secs)
+{
+  double cpu_start = HubThreadCpuSecs();
+
+  for (unsigned long frame = 0; frame < config->frames; frame++)
+  {
+    for (size_t i = first; i < companions->size(); i += step)
+    {
+      HubFrame(&(*companions)[i], frame, config);
+    }
+  }
+
+  *cpu_secs = HubThreadCpuSecs() - cpu_start;
+}
+
+/**
+ * @brief   Run one companion up to the start of a frame, then the frame.
+ * @retval  None.
+ */
+static void HubFrame(hub_companion_t *c, unsigned long frame,
+                     const hub_config_t *config)
+{
+  double frame_start_us = frame * config->frame_us;
+  int16_t sample[WDC_COMM_CHANNELS] = { 0 };
+  uint8_t packet[1 + WDC_TLL_HEADER_LEN + WDC_DLL_CRC_LEN];
+  uint8_t reply[WDC_LOOP_PIPE_SIZE];
+  uint16_t len;
+
+  //
+  // The companion's main loop. Channel 0 of every reading is the
+  // companion's number and channel 1 counts its readings.
+  //
+  while (c->next_loop_us <= frame_start_us)
+  {
+    uint32_t now = (uint32_t)(c->next_loop_us / 1000);
+
+    if ((config->sample_us > 0.0) && (c->next_sample_us <= c->next_loop_us))
+    {
+      sample[0] = c->id;
+      sample[1] = (int16_t)(c->readings + c->refused);
+      if (c->comm_add_sample(sample, now))
+      {
+        c->readings++;
+      }
+      else
+      {
+        c->refused++;
+      }
+      c->next_sample_us += config->sample_us;
+    }
+    c->comm_task(now);
+    c->next_loop_us += config->loop_us;
+  }
+
+  //
+  // The base only acknowledges, on the control endpoint.
+  //
+  packet[0] = WDC_DLLHeaderEncode(WDC_DLL_DIRN_B2C, WDC_DLL_PACKET_TYPE_DATA,
+                                  WDC_DLL_ENDPOINT_CONTROL);
+  packet[1 + WDC_TLL_HEADER_FLAGS_IDX] = 0;
+  packet[1 + WDC_TLL_HEADER_SEQ_IDX] = 0;
+  packet[1 + WDC_TLL_HEADER_ACK_IDX] = c->rx_next;
+  packet[1 + WDC_TLL_HEADER_SACK_IDX] = 0;
+#if (WDC_DLL_CRC == 8)
+  packet[1 + WDC_TLL_HEADER_LEN] = c->crc(WDC_CRC8_INIT, packet,
+                                          1 + WDC_TLL_HEADER_LEN);
+#elif (WDC_DLL_CRC == 16)
+  uint16_t crc = c->crc(WDC_CRC16_INIT, packet, 1 + WDC_TLL_HEADER_LEN);
+
+  packet[1 + WDC_TLL_HEADER_LEN] = (uint8_t)(crc >> 8);
+  packet[2 + WDC_TLL_HEADER_LEN] = (uint8_t)crc;
+#endif
+
+  c->base_start_frame();
+  c->base_write(packet, sizeof(packet));
+  c->base_end_frame();
+
+  len = c->base_read(reply, sizeof(reply));
+  if (len > WDC_DLL_CRC_LEN)
+  {
+    HubReceive(c, reply, (uint16_t)(len - WDC_DLL_CRC_LEN));
+  }
+}
+
+/**
+ * @brief   Take a companion's packet: accept the next segment in order and
+ *          check the readings it carries.
+ * @note    Nothing is lost on a loopback bus, so the base keeps no
+ *          receive window.
+ * @param   len: Length without the CRC trailer.
+ * @retval  None.
+ */
+static void HubReceive(hub_companion_t *c, const uint8_t *packet, uint16_t len)
+{
+  int16_t decoded[256 * WDC_CODEC_MAX_CHANNELS];
+  const uint8_t *segment = &packet[1];
+  uint8_t channels = 0;
+  uint8_t sets;
+
+  if ((WDC_DLLHeaderPacketType(packet[0]) != WDC_DLL_PACKET_TYPE_DATA) ||
+      (WDC_DLLHeaderEndpoint(packet[0]) != WDC_DLL_ENDPOINT_INPUT) ||
+      (len <= 1 + WDC_TLL_HEADER_LEN) ||
+      (segment[WDC_TLL_HEADER_SEQ_IDX] != c->rx_next))
+  {
+    return;
+  }
+  c->rx_next++;
+
+  len -= 1 + WDC_TLL_HEADER_LEN;
+  c->bytes += len;
+  sets = c->codec_decode(&segment[WDC_TLL_HEADER_LEN], (uint8_t)len, decoded,
+                         255, &channels);
+
+  for (uint8_t s = 0; s < sets; s++)
+  {
+    if ((channels == WDC_COMM_CHANNELS) &&
+        (decoded[s * channels] == c->id) &&
+        ((uint16_t)decoded[s * channels + 1] == c->next_count))
+    {
+      c->sets++;
+    }
+    else
+    {
+      c->bad_sets++;
+    }
+    c->next_count = (uint16_t)(decoded[s * channels + 1] + 1);
+  }
+}
+
+/**
+ * @brief   CPU time used by the calling thread.
+ * @retval  Seconds.
+ */
+static double HubThreadCpuSecs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,241 @@
+/**
+  ******************************************************************************
+  * @file    wdc_loopback_bench.cpp
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    08-Sep-2014
+  * @brief   Host benchmark that drives the WDC stack over the loopback PHY and
+  *          reports frames/sec and per-frame latency.
+  *
+  *          See README.md for how to build the host tools.
+  *
+  *          Usage: wdc_loopback_bench [frames] [frame size]
+  *
+  *          Built with -DWDC_TRACE=1 it also reports the latencies recorded
+  *          by the trace ring (see wdc_trace.h).
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "wdc_datalink.h"
+#include "wdc_trace.h"
+#include "wdcloop_physical.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define BENCH_DEFAULT_FRAMES    100000UL
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+/* Private Function Prototypes ---------------------------------------------- */
+static double BenchPercentile(std::vector<double> &samples, double pct);
+#if WDC_TRACE
+static uint32_t BenchTraceClock(void);
+static void BenchTraceCollect(void);
+static void BenchTraceReport(const char *name, std::vector<double> &samples);
+
+/* Private Variables -------------------------------------------------------- */
+static bench_clock_t::time_point trace_epoch;
+static std::vector<double> trace_turnaround_ns;
+static std::vector<double> trace_frame_ns;
+static std::vector<double> trace_dispatch_ns;
+#endif
+
+/* Function Definitions ----------------------------------------------------- */
+int main(int argc, char **argv)
+{
+  unsigned long frames = BENCH_DEFAULT_FRAMES;
+  unsigned long frame_size = WDC_DLL_MAX_FRAME_SIZE;
+  uint8_t frame[WDC_LOOP_PIPE_SIZE];
+  uint8_t sink[WDC_LOOP_PIPE_SIZE];
+  std::vector<double> latency_ns;
+  unsigned long returned = 0;
+
+  if (argc > 1)
+  {
+    frames = strtoul(argv[1], NULL, 0);
+  }
+  if (argc > 2)
+  {
+    frame_size = strtoul(argv[2], NULL, 0);
+  }
+  if ((frames == 0) || (frame_size == 0) || (frame_size >= sizeof(frame)))
+  {
+    fprintf(stderr, "usage: %s [frames] [frame size < %u]\n",
+            argv[0], (unsigned)sizeof(frame));
+    return 1;
+  }
+
+  //
+  // Build a base-to-companion data packet on the control endpoint.
+  //
+  for (unsigned long i = 0; i < frame_size; i++)
+  {
+    frame[i] = (uint8_t)i;
+  }
+  frame[WDC_DLL_HEADER_IDX] = WDC_DLLHeaderEncode(WDC_DLL_DIRN_B2C,
+                                                  WDC_DLL_PACKET_TYPE_DATA,
+                                                  WDC_DLL_ENDPOINT_CONTROL);
+
+  WDC_DLLInit();
+  latency_ns.reserve(frames);
+#if WDC_TRACE
+  trace_epoch = bench_clock_t::now();
+  WDC_TraceSetClock(BenchTraceClock);
+#endif
+
+  bench_clock_t::time_point start = bench_clock_t::now();
+
+  for (unsigned long i = 0; i < frames; i++)
+  {
+    bench_clock_t::time_point t0 = bench_clock_t::now();
+
+    //
+    // Keep the companion's data lane topped up and let its main loop
+    // stage a packet, then run one bus frame: SOF, base payload, EOF,
+    // and collect the companion's packet.
+    //
+    WDC_DLLDataTransmitDataPacket(WDC_DLL_ENDPOINT_INPUT, frame,
+                                  WDC_DLL_DATA_PACKET_LEN - 1);
+    WDC_DLLTask();
+    WDC_LoopBaseStartFrame();
+    WDC_LoopBaseWrite(frame, (uint16_t)frame_size);
+    WDC_LoopBaseEndFrame();
+    returned += WDC_LoopBaseRead(sink, sizeof(sink));
+
+    bench_clock_t::time_point t1 = bench_clock_t::now();
+    latency_ns.push_back(
+      std::chrono::duration<double, std::nano>(t1 - t0).count());
+
+#if WDC_TRACE
+    BenchTraceCollect();
+#endif
+  }
+
+  double elapsed = std::chrono::duration<double>(
+    bench_clock_t::now() - start).count();
+
+  printf("frames          : %lu x %lu bytes\n", frames, frame_size);
+  printf("elapsed         : %.3f s\n", elapsed);
+  printf("frames/sec      : %.0f\n", frames / elapsed);
+  printf("payload MB/sec  : %.2f\n", frames * frame_size / elapsed / 1e6);
+  printf("reply bytes     : %lu\n", returned);
+  printf("latency p50     : %.0f ns\n", BenchPercentile(latency_ns, 50.0));
+  printf("latency p99     : %.0f ns\n", BenchPercentile(latency_ns, 99.0));
+  printf("latency max     : %.0f ns\n", BenchPercentile(latency_ns, 100.0));
+#if WDC_TRACE
+  BenchTraceReport("SOF -> TX start", trace_turnaround_ns);
+  BenchTraceReport("SOF -> EOF", trace_frame_ns);
+  BenchTraceReport("EOF -> dispatch", trace_dispatch_ns);
+#endif
+
+  return 0;
+}
+
+/* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   Nearest-rank percentile of a sample set.
+ * @retval  Sample value at the requested percentile.
+ */
+static double BenchPercentile(std::vector<double> &samples, double pct)
+{
+  size_t rank = (size_t)(pct / 100.0 * (samples.size() - 1) + 0.5);
+
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
+#if WDC_TRACE
+/**
+ * @brief   Trace timestamp source, in WDC_TRACE_TICKS_PER_MS ticks.
+ * @retval  Ticks since the benchmark started.
+ */
+static uint32_t BenchTraceClock(void)
+{
+  return (uint32_t)(std::chrono::duration<double, std::milli>(
+    bench_clock_t::now() - trace_epoch).count() * WDC_TRACE_TICKS_PER_MS);
+}
+
+/**
+ * @brief   Drain the trace ring and turn event pairs into latencies.
+ * @retval  None.
+ */
+static void BenchTraceCollect(void)
+{
+  static bool have_sof = false;
+  static bool have_eof = false;
+  static uint16_t sof = 0;
+  static uint16_t eof = 0;
+  wdc_trace_entry_t entry;
+  double ns_per_tick = 1e6 / WDC_TRACE_TICKS_PER_MS;
+
+  while (WDC_TraceRead(&entry, 1))
+  {
+    switch (entry.event)
+    {
+      case WDC_TRACE_SOF:
+        sof = entry.ticks;
+        have_sof = true;
+        break;
+
+      case WDC_TRACE_TX_START:
+        if (have_sof)
+        {
+          trace_turnaround_ns.push_back((uint16_t)(entry.ticks - sof) * ns_per_tick);
+        }
+        break;
+
+      case WDC_TRACE_EOF:
+        if (have_sof)
+        {
+          trace_frame_ns.push_back((uint16_t)(entry.ticks - sof) * ns_per_tick);
+        }
+        eof = entry.ticks;
+        have_eof = true;
+        break;
+
+      case WDC_TRACE_DLL_DISPATCH:
+        if (have_eof)
+        {
+          trace_dispatch_ns.push_back((uint16_t)(entry.ticks - eof) * ns_per_tick);
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * @brief   Print the distribution of one traced latency.
+ * @retval  None.
+ */
+static void BenchTraceReport(const char *name, std::vector<double> &samples)
+{
+  if (samples.empty())
+  {
+    return;
+  }
+
+  printf("%-16s: p50 %.0f ns, p99 %.0f ns, max %.0f ns\n", name,
+         BenchPercentile(samples, 50.0), BenchPercentile(samples, 99.0),
+         BenchPercentile(samples, 100.0));
+}
+#endif
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -53,46 +53,110 @@
 // using a ring buffer (I think), in which head is the index of the location
 // to which to write the next incoming character and tail is the index of the
 // location from which to read.
-#if (RAMEND < 1000)
-  #define SERIAL_BUFFER_SIZE 16
+//
+// Every buffer size is a power of two (see HardwareSerial.h), so indices wrap
+// with a mask instead of a modulo. When no buffer is larger than 256 bytes the
+// indices are a single byte, which the ISRs and the main loop can read and
+// write atomically.
+#if (SERIAL_RX_BUFFER_SIZE & (SERIAL_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL_TX_BUFFER_SIZE & (SERIAL_TX_BUFFER_SIZE - 1))
+  #error "SERIAL_RX_BUFFER_SIZE and SERIAL_TX_BUFFER_SIZE must be powers of two"
+#endif
+#if (SERIAL1_RX_BUFFER_SIZE & (SERIAL1_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL1_TX_BUFFER_SIZE & (SERIAL1_TX_BUFFER_SIZE - 1)) || \
+    (SERIAL2_RX_BUFFER_SIZE & (SERIAL2_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL2_TX_BUFFER_SIZE & (SERIAL2_TX_BUFFER_SIZE - 1)) || \
+    (SERIAL3_RX_BUFFER_SIZE & (SERIAL3_RX_BUFFER_SIZE - 1)) || \
+    (SERIAL3_TX_BUFFER_SIZE & (SERIAL3_TX_BUFFER_SIZE - 1))
+  #error "SERIALn_RX_BUFFER_SIZE and SERIALn_TX_BUFFER_SIZE must be powers of two"
+#endif
+
+#if (SERIAL_RX_BUFFER_SIZE > 256) || (SERIAL_TX_BUFFER_SIZE > 256) || \
+    (SERIAL1_RX_BUFFER_SIZE > 256) || (SERIAL1_TX_BUFFER_SIZE > 256) || \
+    (SERIAL2_RX_BUFFER_SIZE > 256) || (SERIAL2_TX_BUFFER_SIZE > 256) || \
+    (SERIAL3_RX_BUFFER_SIZE > 256) || (SERIAL3_TX_BUFFER_SIZE > 256)
+  typedef uint16_t ring_index_t;
 #else
-  #define SERIAL_BUFFER_SIZE 64
+  typedef uint8_t ring_index_t;
 #endif
 
 struct ring_buffer
 {
-  unsigned char buffer[SERIAL_BUFFER_SIZE];
-  volatile unsigned int head;
-  volatile unsigned int tail;
+  unsigned char *buffer;
+  ring_index_t mask;
+  volatile ring_index_t head;
+  volatile ring_index_t tail;
+};
+
+#define RING_BUFFER(name, size) \
+  static unsigned char name##_storage[size]; \
+  ring_buffer name = { name##_storage, (ring_index_t)((size) - 1), 0, 0 }
+
+// While a receive target is attached, the RX ISR stores bytes straight into
+// the caller's buffer instead of the ring buffer. This lets a framed protocol
+// receive a whole frame without copying it out of the ring afterwards.
+struct receive_target
+{
+  unsigned char *buffer;
+  uint8_t size;
+  volatile uint8_t count;
+};
+
+// Callbacks raised from a port's ISRs. Each port has its own set, so
+// several ports can run independent protocols.
+struct serial_handlers
+{
+  serial_callback_t transmit_complete;
+  serial_callback_t transmit_space;
+  serial_callback_t receive_start;
 };
 
 #if defined(USBCON)
-  ring_buffer rx_buffer = { { 0 }, 0, 0};
-  ring_buffer tx_buffer = { { 0 }, 0, 0};
+  RING_BUFFER(rx_buffer, SERIAL_RX_BUFFER_SIZE);
+  RING_BUFFER(tx_buffer, SERIAL_TX_BUFFER_SIZE);
+  receive_target rx_target = { NULL, 0, 0 };
+  serial_stats port_stats = { 0, 0, 0 };
+  serial_handlers port_handlers = { NULL, NULL, NULL };
 #endif
 #if defined(UBRRH) || defined(UBRR0H)
-  ring_buffer rx_buffer  =  { { 0 }, 0, 0 };
-  ring_buffer tx_buffer  =  { { 0 }, 0, 0 };
+  RING_BUFFER(rx_buffer, SERIAL_RX_BUFFER_SIZE);
+  RING_BUFFER(tx_buffer, SERIAL_TX_BUFFER_SIZE);
+  receive_target rx_target = { NULL, 0, 0 };
+  serial_stats port_stats = { 0, 0, 0 };
+  serial_handlers port_handlers = { NULL, NULL, NULL };
 #endif
 #if defined(UBRR1H)
-  ring_buffer rx_buffer1  =  { { 0 }, 0, 0 };
-  ring_buffer tx_buffer1  =  { { 0 }, 0, 0 };
+  RING_BUFFER(rx_buffer1, SERIAL1_RX_BUFFER_SIZE);
+  RING_BUFFER(tx_buffer1, SERIAL1_TX_BUFFER_SIZE);
+  receive_target rx_target1 = { NULL, 0, 0 };
+  serial_stats port_stats1 = { 0, 0, 0 };
+  serial_handlers port_handlers1 = { NULL, NULL, NULL };
 #endif
 #if defined(UBRR2H)
-  ring_buffer rx_buffer2  =  { { 0 }, 0, 0 };
-  ring_buffer tx_buffer2  =  { { 0 }, 0, 0 };
+  RING_BUFFER(rx_buffer2, SERIAL2_RX_BUFFER_SIZE);
+  RING_BUFFER(tx_buffer2, SERIAL2_TX_BUFFER_SIZE);
+  receive_target rx_target2 = { NULL, 0, 0 };
+  serial_stats port_stats2 = { 0, 0, 0 };
+  serial_handlers port_handlers2 = { NULL, NULL, NULL };
 #endif
 #if defined(UBRR3H)
-  ring_buffer rx_buffer3  =  { { 0 }, 0, 0 };
-  ring_buffer tx_buffer3  =  { { 0 }, 0, 0 };
+  RING_BUFFER(rx_buffer3, SERIAL3_RX_BUFFER_SIZE);
+  RING_BUFFER(tx_buffer3, SERIAL3_TX_BUFFER_SIZE);
+  receive_target rx_target3 = { NULL, 0, 0 };
+  serial_stats port_stats3 = { 0, 0, 0 };
+  serial_handlers port_handlers3 = { NULL, NULL, NULL };
 #endif
 
-typedef void (*serial_callback_t)(void);
-serial_callback_t transmit_complete_handler = NULL;
+inline void stat_inc(volatile uint16_t &counter)
+{
+  // saturate rather than wrap
+  if (counter != 0xFFFF)
+    counter++;
+}
 
-inline void store_char(unsigned char c, ring_buffer *buffer)
+inline bool store_char(unsigned char c, ring_buffer *buffer)
 {
-  int i = (unsigned int)(buffer->head + 1) % SERIAL_BUFFER_SIZE;
+  ring_index_t i = (buffer->head + 1) & buffer->mask;
 
   // if we should be storing the received character into the location
   // just before the tail (meaning that the head would advance to the
@@ -101,9 +165,64 @@ inline void store_char(unsigned char c, ring_buffer *buffer)
   if (i != buffer->tail) {
     buffer->buffer[buffer->head] = c;
     buffer->head = i;
+    return true;
+  }
+  return false;
+}
+
+inline void receive_char(unsigned char c, ring_buffer *buffer, receive_target *target,
+  serial_stats *stats, serial_handlers *handlers)
+{
+  // bytes beyond the end of an attached target are dropped, just like
+  // bytes arriving while the ring buffer is full
+  if (target->buffer) {
+    // the first byte into a target marks the start of a received frame
+    if ((target->count == 0) && handlers->receive_start)
+      handlers->receive_start();
+    if (target->count < target->size) {
+      target->buffer[target->count] = c;
+      target->count++;
+    } else {
+      stat_inc(stats->rx_overruns);
+    }
+  } else if (!store_char(c, buffer)) {
+    stat_inc(stats->rx_overruns);
   }
 }
 
+inline void transmit_next(ring_buffer *buffer, serial_handlers *handlers,
+  volatile uint8_t *ucsrb, uint8_t udrie, uint8_t txcie, volatile uint8_t *udr)
+{
+  if (buffer->head == buffer->tail) {
+    // Buffer empty, so disable interrupts. The last byte is still being
+    // shifted out; the TXC interrupt says when its stop bit is done.
+    cbi(*ucsrb, udrie);
+    sbi(*ucsrb, txcie);
+  }
+  else {
+    // There is more data in the output buffer. Send the next byte
+    unsigned char c = buffer->buffer[buffer->tail];
+    buffer->tail = (buffer->tail + 1) & buffer->mask;
+    *udr = c;
+
+    // The last buffered byte just went out. Let the owner refill the
+    // buffer while that byte is still being shifted out.
+    if ((buffer->head == buffer->tail) && handlers->transmit_space)
+      handlers->transmit_space();
+  }
+}
+
+inline void transmit_done(serial_handlers *handlers, volatile uint8_t *ucsrb,
+  uint8_t txcie)
+{
+  // Nothing left in UDR or the shift register. Entering the ISR cleared
+  // the TXC flag; one completion per drained buffer.
+  cbi(*ucsrb, txcie);
+
+  if (handlers->transmit_complete)
+    handlers->transmit_complete();
+}
+
 #if !defined(USART0_RX_vect) && defined(USART1_RX_vect)
 // do nothing - on the 32u4 the first USART is USART1
 #else
@@ -125,16 +244,18 @@ inline void store_char(unsigned char c, ring_buffer *buffer)
   #if defined(UDR0)
     if (bit_is_clear(UCSR0A, UPE0)) {
       unsigned char c = UDR0;
-      store_char(c, &rx_buffer);
+      receive_char(c, &rx_buffer, &rx_target, &port_stats, &port_handlers);
     } else {
       unsigned char c = UDR0;
+      stat_inc(port_stats.rx_parity_errors);
     };
   #elif defined(UDR)
     if (bit_is_clear(UCSRA, PE)) {
       unsigned char c = UDR;
-      store_char(c, &rx_buffer);
+      receive_char(c, &rx_buffer, &rx_target, &port_stats, &port_handlers);
     } else {
       unsigned char c = UDR;
+      stat_inc(port_stats.rx_parity_errors);
     };
   #else
     #error UDR not defined
@@ -151,9 +272,10 @@ inline void store_char(unsigned char c, ring_buffer *buffer)
   {
     if (bit_is_clear(UCSR1A, UPE1)) {
       unsigned char c = UDR1;
-      store_char(c, &rx_buffer1);
+      receive_char(c, &rx_buffer1, &rx_target1, &port_stats1, &port_handlers1);
     } else {
       unsigned char c = UDR1;
+      stat_inc(port_stats1.rx_parity_errors);
     };
   }
 #endif
@@ -166,9 +288,10 @@ inline void store_char(unsigned char c, ring_buffer *buffer)
   {
     if (bit_is_clear(UCSR2A, UPE2)) {
       unsigned char c = UDR2;
-      store_char(c, &rx_buffer2);
+      receive_char(c, &rx_buffer2, &rx_target2, &port_stats2, &port_handlers2);
     } else {
       unsigned char c = UDR2;
+      stat_inc(port_stats2.rx_parity_errors);
     };
   }
 #endif
@@ -181,9 +304,10 @@ inline void store_char(unsigned char c, ring_buffer *buffer)
   {
     if (bit_is_clear(UCSR3A, UPE3)) {
       unsigned char c = UDR3;
-      store_char(c, &rx_buffer3);
+      receive_char(c, &rx_buffer3, &rx_target3, &port_stats3, &port_handlers3);
     } else {
       unsigned char c = UDR3;
+      stat_inc(port_stats3.rx_parity_errors);
     };
   }
 #endif
@@ -221,31 +345,11 @@ ISR(USART0_UDRE_vect)
 ISR(USART_UDRE_vect)
 #endif
 {
-  if (tx_buffer.head == tx_buffer.tail) {
-	// Buffer empty, so disable interrupts
 #if defined(UCSR0B)
-    cbi(UCSR0B, UDRIE0);
+  transmit_next(&tx_buffer, &port_handlers, &UCSR0B, UDRIE0, TXCIE0, &UDR0);
 #else
-    cbi(UCSRB, UDRIE);
+  transmit_next(&tx_buffer, &port_handlers, &UCSRB, UDRIE, TXCIE, &UDR);
 #endif
-
-    if (transmit_complete_handler) {
-      transmit_complete_handler();
-    }
-  }
-  else {
-    // There is more data in the output buffer. Send the next byte
-    unsigned char c = tx_buffer.buffer[tx_buffer.tail];
-    tx_buffer.tail = (tx_buffer.tail + 1) % SERIAL_BUFFER_SIZE;
-	
-  #if defined(UDR0)
-    UDR0 = c;
-  #elif defined(UDR)
-    UDR = c;
-  #else
-    #error UDR not defined
-  #endif
-  }
 }
 #endif
 #endif
@@ -253,51 +357,69 @@ ISR(USART_UDRE_vect)
 #ifdef USART1_UDRE_vect
 ISR(USART1_UDRE_vect)
 {
-  if (tx_buffer1.head == tx_buffer1.tail) {
-	// Buffer empty, so disable interrupts
-    cbi(UCSR1B, UDRIE1);
-  }
-  else {
-    // There is more data in the output buffer. Send the next byte
-    unsigned char c = tx_buffer1.buffer[tx_buffer1.tail];
-    tx_buffer1.tail = (tx_buffer1.tail + 1) % SERIAL_BUFFER_SIZE;
-	
-    UDR1 = c;
-  }
+  transmit_next(&tx_buffer1, &port_handlers1, &UCSR1B, UDRIE1, TXCIE1, &UDR1);
 }
 #endif
 
 #ifdef USART2_UDRE_vect
 ISR(USART2_UDRE_vect)
 {
-  if (tx_buffer2.head == tx_buffer2.tail) {
-	// Buffer empty, so disable interrupts
-    cbi(UCSR2B, UDRIE2);
-  }
-  else {
-    // There is more data in the output buffer. Send the next byte
-    unsigned char c = tx_buffer2.buffer[tx_buffer2.tail];
-    tx_buffer2.tail = (tx_buffer2.tail + 1) % SERIAL_BUFFER_SIZE;
-	
-    UDR2 = c;
-  }
+  transmit_next(&tx_buffer2, &port_handlers2, &UCSR2B, UDRIE2, TXCIE2, &UDR2);
 }
 #endif
 
 #ifdef USART3_UDRE_vect
 ISR(USART3_UDRE_vect)
 {
-  if (tx_buffer3.head == tx_buffer3.tail) {
-	// Buffer empty, so disable interrupts
-    cbi(UCSR3B, UDRIE3);
-  }
-  else {
-    // There is more data in the output buffer. Send the next byte
-    unsigned char c = tx_buffer3.buffer[tx_buffer3.tail];
-    tx_buffer3.tail = (tx_buffer3.tail + 1) % SERIAL_BUFFER_SIZE;
-	
-    UDR3 = c;
-  }
+  transmit_next(&tx_buffer3, &port_handlers3, &UCSR3B, UDRIE3, TXCIE3, &UDR3);
+}
+#endif
+
+#if !defined(USART0_TX_vect) && defined(USART1_TX_vect)
+// do nothing - on the 32u4 the first USART is USART1
+#else
+#if !defined(UART0_TX_vect) && !defined(UART_TX_vect) && !defined(USART0_TX_vect) && !defined(USART_TX_vect) && !defined(USART_TXC_vect)
+  #error "Don't know what the Transmit Complete vector is called for the first UART"
+#else
+#if defined(UART0_TX_vect)
+ISR(UART0_TX_vect)
+#elif defined(UART_TX_vect)
+ISR(UART_TX_vect)
+#elif defined(USART0_TX_vect)
+ISR(USART0_TX_vect)
+#elif defined(USART_TX_vect)
+ISR(USART_TX_vect)
+#elif defined(USART_TXC_vect)
+ISR(USART_TXC_vect) // ATmega8
+#endif
+{
+#if defined(UCSR0B)
+  transmit_done(&port_handlers, &UCSR0B, TXCIE0);
+#else
+  transmit_done(&port_handlers, &UCSRB, TXCIE);
+#endif
+}
+#endif
+#endif
+
+#ifdef USART1_TX_vect
+ISR(USART1_TX_vect)
+{
+  transmit_done(&port_handlers1, &UCSR1B, TXCIE1);
+}
+#endif
+
+#ifdef USART2_TX_vect
+ISR(USART2_TX_vect)
+{
+  transmit_done(&port_handlers2, &UCSR2B, TXCIE2);
+}
+#endif
+
+#ifdef USART3_TX_vect
+ISR(USART3_TX_vect)
+{
+  transmit_done(&port_handlers3, &UCSR3B, TXCIE3);
 }
 #endif
 
@@ -305,13 +427,18 @@ ISR(USART3_UDRE_vect)
 // Constructors ////////////////////////////////////////////////////////////////
 
 HardwareSerial::HardwareSerial(ring_buffer *rx_buffer, ring_buffer *tx_buffer,
+  receive_target *rx_target, serial_stats *stats, serial_handlers *handlers,
   volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
   volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
   volatile uint8_t *ucsrc, volatile uint8_t *udr,
-  uint8_t rxen, uint8_t txen, uint8_t rxcie, uint8_t udrie, uint8_t u2x)
+  uint8_t rxen, uint8_t txen, uint8_t rxcie, uint8_t udrie, uint8_t txcie,
+  uint8_t u2x)
 {
   _rx_buffer = rx_buffer;
   _tx_buffer = tx_buffer;
+  _rx_target = rx_target;
+  _stats = stats;
+  _handlers = handlers;
   _ubrrh = ubrrh;
   _ubrrl = ubrrl;
   _ucsra = ucsra;
@@ -322,102 +449,43 @@ HardwareSerial::HardwareSerial(ring_buffer *rx_buffer, ring_buffer *tx_buffer,
   _txen = txen;
   _rxcie = rxcie;
   _udrie = udrie;
+  _txcie = txcie;
   _u2x = u2x;
+  _tx_hold = false;
 }
 
 // Public Methods //////////////////////////////////////////////////////////////
 
 void HardwareSerial::begin(unsigned long baud)
 {
-  uint16_t baud_setting;
-  bool use_u2x = true;
-
-#if F_CPU == 16000000UL
-  // hardcoded exception for compatibility with the bootloader shipped
-  // with the Duemilanove and previous boards and the firmware on the 8U2
-  // on the Uno and Mega 2560.
-  if (baud == 57600) {
-    use_u2x = false;
-  }
-#endif
-
-try_again:
-  
-  if (use_u2x) {
-    *_ucsra = 1 << _u2x;
-    baud_setting = (F_CPU / 4 / baud - 1) / 2;
-  } else {
-    *_ucsra = 0;
-    baud_setting = (F_CPU / 8 / baud - 1) / 2;
-  }
-  
-  if ((baud_setting > 4095) && use_u2x)
-  {
-    use_u2x = false;
-    goto try_again;
-  }
-
-  // assign the baud_setting, a.k.a. ubbr (USART Baud Rate Register)
-  *_ubrrh = baud_setting >> 8;
-  *_ubrrl = baud_setting;
-
-  transmitting = false;
-
-  sbi(*_ucsrb, _rxen);
-  sbi(*_ucsrb, _txen);
-  sbi(*_ucsrb, _rxcie);
-  cbi(*_ucsrb, _udrie);
+  setBaud(baud);
+  enable();
 }
 
 void HardwareSerial::begin(unsigned long baud, byte config)
 {
-  uint16_t baud_setting;
-  uint8_t current_config;
-  bool use_u2x = true;
-
-#if F_CPU == 16000000UL
-  // hardcoded exception for compatibility with the bootloader shipped
-  // with the Duemilanove and previous boards and the firmware on the 8U2
-  // on the Uno and Mega 2560.
-  if (baud == 57600) {
-    use_u2x = false;
-  }
-#endif
-
-try_again:
-  
-  if (use_u2x) {
-    *_ucsra = 1 << _u2x;
-    baud_setting = (F_CPU / 4 / baud - 1) / 2;
-  } else {
-    *_ucsra = 0;
-    baud_setting = (F_CPU / 8 / baud - 1) / 2;
-  }
-  
-  if ((baud_setting > 4095) && use_u2x)
-  {
-    use_u2x = false;
-    goto try_again;
-  }
+  setBaud(baud);
+  setConfig(config);
+  enable();
+}
 
-  // assign the baud_setting, a.k.a. ubbr (USART Baud Rate Register)
+void HardwareSerial::setBaudSetting(uint16_t baud_setting, bool use_u2x)
+{
+  // Change the rate of a running port without the division in begin().
+  // The caller picks a moment when no byte is being sent or received.
+  *_ucsra = use_u2x ? (1 << _u2x) : 0;
   *_ubrrh = baud_setting >> 8;
   *_ubrrl = baud_setting;
-
-  //set the data bits, parity, and stop bits
-#if defined(__AVR_ATmega8__)
-  config |= 0x80; // select UCSRC register (shared with UBRRH)
-#endif
-  *_ucsrc = config;
-  
-  sbi(*_ucsrb, _rxen);
-  sbi(*_ucsrb, _txen);
-  sbi(*_ucsrb, _rxcie);
-  cbi(*_ucsrb, _udrie);
 }
 
 void HardwareSerial::end()
 {
+  // drop data held back by holdTransmit(); it would never go out
+  if (_tx_hold) {
+    _tx_buffer->tail = _tx_buffer->head;
+    _tx_hold = false;
+  }
+
   // wait for transmission of outgoing data
   while (_tx_buffer->head != _tx_buffer->tail)
     ;
@@ -426,6 +494,7 @@ void HardwareSerial::end()
   cbi(*_ucsrb, _txen);
   cbi(*_ucsrb, _rxcie);  
   cbi(*_ucsrb, _udrie);
+  cbi(*_ucsrb, _txcie);
   
   // clear any received data
   _rx_buffer->head = _rx_buffer->tail;
@@ -433,7 +502,7 @@ void HardwareSerial::end()
 
 int HardwareSerial::available(void)
 {
-  return (unsigned int)(SERIAL_BUFFER_SIZE + _rx_buffer->head - _rx_buffer->tail) % SERIAL_BUFFER_SIZE;
+  return (ring_index_t)(_rx_buffer->head - _rx_buffer->tail) & _rx_buffer->mask;
 }
 
 int HardwareSerial::peek(void)
@@ -452,15 +521,22 @@ int HardwareSerial::read(void)
     return -1;
   } else {
     unsigned char c = _rx_buffer->buffer[_rx_buffer->tail];
-    _rx_buffer->tail = (unsigned int)(_rx_buffer->tail + 1) % SERIAL_BUFFER_SIZE;
+    _rx_buffer->tail = (_rx_buffer->tail + 1) & _rx_buffer->mask;
     return c;
   }
 }
 
 void HardwareSerial::flush()
 {
-  // UDR is kept full while the buffer is not empty, so TXC triggers when EMPTY && SENT
-  while (transmitting && ! (*_ucsra & _BV(TXC0)));
+  // UDR is kept full while the buffer is not empty, so TXC triggers when EMPTY && SENT.
+  // The TXC interrupt clears the flag when it runs, so also stop once both
+  // transmit interrupts are off again.
+  // Bytes buffered under holdTransmit() are not sent until
+  // releaseTransmit(), which may never come, so do not wait for them.
+  if (_tx_hold)
+    return;
+  while (transmitting && ! (*_ucsra & _BV(TXC0)) &&
+         (*_ucsrb & (_BV(_udrie) | _BV(_txcie))));
   transmitting = false;
 }
 
@@ -471,20 +547,97 @@ void HardwareSerial::flushReceiveBuffer()
   _rx_buffer->head = _rx_buffer->tail;
 }
 
+size_t HardwareSerial::readBlock(uint8_t *buffer, size_t size)
+{
+  // Copy out whatever has already arrived (up to size bytes) without the
+  // per-byte overhead and timeout of Stream::readBytes. The data is in at
+  // most two contiguous runs: tail to the end of the buffer, then the start.
+  ring_index_t head = _rx_buffer->head;
+  ring_index_t tail = _rx_buffer->tail;
+  size_t count = (ring_index_t)(head - tail) & _rx_buffer->mask;
+  size_t run = (size_t)_rx_buffer->mask + 1 - tail;
+
+  if (count > size)
+    count = size;
+  if (run > count)
+    run = count;
+
+  memcpy(buffer, _rx_buffer->buffer + tail, run);
+  memcpy(buffer + run, _rx_buffer->buffer, count - run);
+  _rx_buffer->tail = (tail + count) & _rx_buffer->mask;
+
+  return count;
+}
+
+int HardwareSerial::writeAvailable(void)
+{
+  return (ring_index_t)(_tx_buffer->tail - _tx_buffer->head - 1) & _tx_buffer->mask;
+}
+
+size_t HardwareSerial::tryWrite(const uint8_t *buffer, size_t size)
+{
+  // Copy as much of the block as fits into the transmit buffer in at most
+  // two runs, then kick the UDRE interrupt once for the whole chunk (unless
+  // the transmitter is held). Never waits for the ISR; the caller gets the
+  // number of bytes accepted.
+  ring_index_t head = _tx_buffer->head;
+  size_t count = (ring_index_t)(_tx_buffer->tail - head - 1) & _tx_buffer->mask;
+  size_t run = (size_t)_tx_buffer->mask + 1 - head;
+
+  if (count > size)
+    count = size;
+  if (count == 0)
+    return 0;
+  if (run > count)
+    run = count;
+
+  memcpy(_tx_buffer->buffer + head, buffer, run);
+  memcpy(_tx_buffer->buffer, buffer + run, count - run);
+  _tx_buffer->head = (head + count) & _tx_buffer->mask;
+
+  if (!_tx_hold)
+    sbi(*_ucsrb, _udrie);
+  // clear the TXC bit -- "can be cleared by writing a one to its bit location"
+  transmitting = true;
+  sbi(*_ucsra, TXC0);
+
+  return count;
+}
+
+size_t HardwareSerial::writeBlock(const uint8_t *buffer, size_t size)
+{
+  size_t written;
+
+  // Only a block larger than the free space has to wait for the ISR to
+  // drain the transmit buffer.
+  written = tryWrite(buffer, size);
+  if (written < size) {
+    stat_inc(_stats->tx_waits);
+    while (written < size)
+      written += tryWrite(buffer + written, size - written);
+  }
+
+  return written;
+}
+
 size_t HardwareSerial::write(uint8_t c)
 {
-  int i = (_tx_buffer->head + 1) % SERIAL_BUFFER_SIZE;
+  ring_index_t i = (_tx_buffer->head + 1) & _tx_buffer->mask;
 	
   // If the output buffer is full, there's nothing for it other than to 
   // wait for the interrupt handler to empty it a bit
   // ???: return 0 here instead?
-  while (i == _tx_buffer->tail)
-    ;
+  if (i == _tx_buffer->tail) {
+    stat_inc(_stats->tx_waits);
+    while (i == _tx_buffer->tail)
+      ;
+  }
 	
   _tx_buffer->buffer[_tx_buffer->head] = c;
   _tx_buffer->head = i;
 	
-  sbi(*_ucsrb, _udrie);
+  if (!_tx_hold)
+    sbi(*_ucsrb, _udrie);
   // clear the TXC bit -- "can be cleared by writing a one to its bit location"
   transmitting = true;
   sbi(*_ucsra, TXC0);
@@ -492,21 +645,145 @@ size_t HardwareSerial::write(uint8_t c)
   return 1;
 }
 
+void HardwareSerial::holdTransmit(void)
+{
+  // Let bytes collect in the transmit buffer without starting the UART.
+  // Only use tryWrite() while held: write() and writeBlock() wait for
+  // room that never frees up. Held bytes do not count as sent: flush()
+  // returns without them and end() drops them.
+  _tx_hold = true;
+}
+
+void HardwareSerial::releaseTransmit(void)
+{
+  // Start sending whatever was buffered while held. Cheap enough to call
+  // from an ISR.
+  _tx_hold = false;
+  if (_tx_buffer->head != _tx_buffer->tail)
+    sbi(*_ucsrb, _udrie);
+}
+
+void HardwareSerial::attachReceiveTarget(uint8_t *buffer, uint8_t size)
+{
+  uint8_t oldSREG = SREG;
+
+  cli();
+  _rx_target->count = 0;
+  _rx_target->size = size;
+  _rx_target->buffer = buffer;
+  SREG = oldSREG;
+}
+
+uint8_t HardwareSerial::detachReceiveTarget(void)
+{
+  uint8_t oldSREG = SREG;
+  uint8_t count;
+
+  cli();
+  _rx_target->buffer = NULL;
+  count = _rx_target->count;
+  SREG = oldSREG;
+
+  return count;
+}
+
+uint8_t HardwareSerial::receiveTargetCount(void)
+{
+  return _rx_target->count;
+}
+
 void HardwareSerial::attachTransmitCompleteHandler(serial_callback_t cb)
 {
-  transmit_complete_handler = cb;
+  _handlers->transmit_complete = cb;
+}
+
+void HardwareSerial::attachTransmitSpaceHandler(serial_callback_t cb)
+{
+  _handlers->transmit_space = cb;
+}
+
+void HardwareSerial::attachReceiveStartHandler(serial_callback_t cb)
+{
+  _handlers->receive_start = cb;
+}
+
+void HardwareSerial::readStats(serial_stats *stats, bool clear)
+{
+  uint8_t oldSREG = SREG;
+
+  // take a consistent copy; the RX ISR updates the counters
+  cli();
+  stats->rx_overruns = _stats->rx_overruns;
+  stats->rx_parity_errors = _stats->rx_parity_errors;
+  stats->tx_waits = _stats->tx_waits;
+  if (clear) {
+    _stats->rx_overruns = 0;
+    _stats->rx_parity_errors = 0;
+    _stats->tx_waits = 0;
+  }
+  SREG = oldSREG;
 }
 
 HardwareSerial::operator bool() {
 	return true;
 }
 
+// Private Methods /////////////////////////////////////////////////////////////
+
+void HardwareSerial::setBaud(unsigned long baud)
+{
+  uint16_t baud_setting;
+  bool use_u2x = true;
+
+#if F_CPU == 16000000UL
+  // hardcoded exception for compatibility with the bootloader shipped
+  // with the Duemilanove and previous boards and the firmware on the 8U2
+  // on the Uno and Mega 2560.
+  if (baud == 57600) {
+    use_u2x = false;
+  }
+#endif
+
+  if (use_u2x) {
+    baud_setting = (F_CPU / 4 / baud - 1) / 2;
+    if (baud_setting > 4095) {
+      use_u2x = false;
+    }
+  }
+  if (!use_u2x) {
+    baud_setting = (F_CPU / 8 / baud - 1) / 2;
+  }
+
+  // assign the baud_setting, a.k.a. ubbr (USART Baud Rate Register)
+  setBaudSetting(baud_setting, use_u2x);
+}
+
+void HardwareSerial::setConfig(uint8_t config)
+{
+  //set the data bits, parity, and stop bits
+#if defined(__AVR_ATmega8__)
+  config |= 0x80; // select UCSRC register (shared with UBRRH)
+#endif
+  *_ucsrc = config;
+}
+
+void HardwareSerial::enable(void)
+{
+  transmitting = false;
+
+  sbi(*_ucsrb, _rxen);
+  sbi(*_ucsrb, _txen);
+  sbi(*_ucsrb, _rxcie);
+  cbi(*_ucsrb, _udrie);
+  cbi(*_ucsrb, _txcie);
+}
+
 // Preinstantiate Objects //////////////////////////////////////////////////////
 
 #if defined(UBRRH) && defined(UBRRL)
-  HardwareSerial Serial(&rx_buffer, &tx_buffer, &UBRRH, &UBRRL, &UCSRA, &UCSRB, &UCSRC, &UDR, RXEN, TXEN, RXCIE, UDRIE, U2X);
+  HardwareSerial Serial(&rx_buffer, &tx_buffer, &rx_target, &port_stats, &port_handlers, &UBRRH, &UBRRL, &UCSRA, &UCSRB, &UCSRC, &UDR, RXEN, TXEN, RXCIE, UDRIE, TXCIE, U2X);
 #elif defined(UBRR0H) && defined(UBRR0L)
-  HardwareSerial Serial(&rx_buffer, &tx_buffer, &UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0, RXEN0, TXEN0, RXCIE0, UDRIE0, U2X0);
+  HardwareSerial Serial(&rx_buffer, &tx_buffer, &rx_target, &port_stats, &port_handlers, &UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0, RXEN0, TXEN0, RXCIE0, UDRIE0, TXCIE0, U2X0);
 #elif defined(USBCON)
   // do nothing - Serial object and buffers are initialized in CDC code
 #else
@@ -514,13 +791,13 @@ HardwareSerial::operator bool() {
 #endif
 
 #if defined(UBRR1H)
-  HardwareSerial Serial1(&rx_buffer1, &tx_buffer1, &UBRR1H, &UBRR1L, &UCSR1A, &UCSR1B, &UCSR1C, &UDR1, RXEN1, TXEN1, RXCIE1, UDRIE1, U2X1);
+  HardwareSerial Serial1(&rx_buffer1, &tx_buffer1, &rx_target1, &port_stats1, &port_handlers1, &UBRR1H, &UBRR1L, &UCSR1A, &UCSR1B, &UCSR1C, &UDR1, RXEN1, TXEN1, RXCIE1, UDRIE1, TXCIE1, U2X1);
 #endif
 #if defined(UBRR2H)
-  HardwareSerial Serial2(&rx_buffer2, &tx_buffer2, &UBRR2H, &UBRR2L, &UCSR2A, &UCSR2B, &UCSR2C, &UDR2, RXEN2, TXEN2, RXCIE2, UDRIE2, U2X2);
+  HardwareSerial Serial2(&rx_buffer2, &tx_buffer2, &rx_target2, &port_stats2, &port_handlers2, &UBRR2H, &UBRR2L, &UCSR2A, &UCSR2B, &UCSR2C, &UDR2, RXEN2, TXEN2, RXCIE2, UDRIE2, TXCIE2, U2X2);
 #endif
 #if defined(UBRR3H)
-  HardwareSerial Serial3(&rx_buffer3, &tx_buffer3, &UBRR3H, &UBRR3L, &UCSR3A, &UCSR3B, &UCSR3C, &UDR3, RXEN3, TXEN3, RXCIE3, UDRIE3, U2X3);
+  HardwareSerial Serial3(&rx_buffer3, &tx_buffer3, &rx_target3, &port_stats3, &port_handlers3, &UBRR3H, &UBRR3L, &UCSR3A, &UCSR3B, &UCSR3C, &UDR3, RXEN3, TXEN3, RXCIE3, UDRIE3, TXCIE3, U2X3);
 #endif
 
 #endif // whole file
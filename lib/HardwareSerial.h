@@ -24,18 +24,104 @@
 #define HardwareSerial_h
 
 #include <inttypes.h>
+#include <avr/io.h>
 
 #include "Stream.h"
 
+// Define the ring buffer sizes of each port. Every size must be a power of
+// two. Port 0 carries the WDC bus, so it gets a receive buffer large enough
+// to hold several frames; ports 1-3 are unused by default and get tiny ones.
+// Any of these can be overridden on the compiler command line.
+#if (RAMEND < 1000)
+  #define SERIAL_DEFAULT_BUFFER_SIZE 16
+  #define SERIAL_LARGE_BUFFER_SIZE 64
+#else
+  #define SERIAL_DEFAULT_BUFFER_SIZE 64
+  #define SERIAL_LARGE_BUFFER_SIZE 256
+#endif
+
+#ifndef SERIAL_RX_BUFFER_SIZE
+  #define SERIAL_RX_BUFFER_SIZE SERIAL_LARGE_BUFFER_SIZE
+#endif
+#ifndef SERIAL_TX_BUFFER_SIZE
+  #define SERIAL_TX_BUFFER_SIZE SERIAL_DEFAULT_BUFFER_SIZE
+#endif
+#ifndef SERIAL1_RX_BUFFER_SIZE
+  #define SERIAL1_RX_BUFFER_SIZE 16
+#endif
+#ifndef SERIAL1_TX_BUFFER_SIZE
+  #define SERIAL1_TX_BUFFER_SIZE 16
+#endif
+#ifndef SERIAL2_RX_BUFFER_SIZE
+  #define SERIAL2_RX_BUFFER_SIZE 16
+#endif
+#ifndef SERIAL2_TX_BUFFER_SIZE
+  #define SERIAL2_TX_BUFFER_SIZE 16
+#endif
+#ifndef SERIAL3_RX_BUFFER_SIZE
+  #define SERIAL3_RX_BUFFER_SIZE 16
+#endif
+#ifndef SERIAL3_TX_BUFFER_SIZE
+  #define SERIAL3_TX_BUFFER_SIZE 16
+#endif
+
 struct ring_buffer;
+struct receive_target;
+struct serial_handlers;
+
+// Events that would otherwise go unnoticed. Each count sticks at 0xFFFF
+// instead of wrapping.
+struct serial_stats
+{
+  volatile uint16_t rx_overruns;       // bytes dropped, buffer or target full
+  volatile uint16_t rx_parity_errors;  // bytes dropped with a parity error
+  volatile uint16_t tx_waits;          // writes that waited for buffer space
+};
 
 typedef void (*serial_callback_t)(void);
 
+// Baud rate register settings worked out by the compiler instead of by
+// begin() at run time. SerialBaudSetting<BAUD>::ubrr and ::u2x are the
+// UBRR value and double-speed flag for BAUD (double speed is used unless
+// its UBRR would not fit), ::actual is the rate they really produce and
+// ::error_permille how far that is from BAUD, in tenths of a percent.
+// Rates above CLOCK / 8 cannot be produced and report an error of 1000.
+template <unsigned long BAUD, unsigned long CLOCK = F_CPU>
+struct SerialBaudSetting
+{
+  static const unsigned long ubrr_u2x = (CLOCK + 4UL * BAUD) / (8UL * BAUD) - 1;
+  static const unsigned long ubrr_1x = (CLOCK + 8UL * BAUD) / (16UL * BAUD) - 1;
+  static const bool reachable = (BAUD <= CLOCK / 8UL);
+  static const bool u2x = reachable && (ubrr_u2x <= 4095);
+  static const uint16_t ubrr = !reachable ? 0 : u2x ? ubrr_u2x : ubrr_1x;
+  static const unsigned long actual =
+    CLOCK / ((u2x ? 8UL : 16UL) * ((unsigned long)ubrr + 1));
+  static const uint16_t error_permille = !reachable ? 1000 :
+    (uint16_t)(((actual > BAUD) ? (actual - BAUD) : (BAUD - actual)) * 1000UL / BAUD);
+};
+
+// As SerialBaudSetting, but the build fails if the rate is off by more
+// than MAX_ERROR tenths of a percent on this clock.
+template <unsigned long BAUD, uint16_t MAX_ERROR = 20, unsigned long CLOCK = F_CPU>
+struct SerialBaud : SerialBaudSetting<BAUD, CLOCK>
+{
+#if __cplusplus >= 201103L
+  static_assert(SerialBaudSetting<BAUD, CLOCK>::error_permille <= MAX_ERROR,
+                "Baud rate error too large on this F_CPU.");
+#else
+  typedef char baud_rate_error_too_large
+    [(SerialBaudSetting<BAUD, CLOCK>::error_permille <= MAX_ERROR) ? 1 : -1];
+#endif
+};
+
 class HardwareSerial : public Stream
 {
   private:
     ring_buffer *_rx_buffer;
     ring_buffer *_tx_buffer;
+    receive_target *_rx_target;
+    serial_stats *_stats;
+    serial_handlers *_handlers;
     volatile uint8_t *_ubrrh;
     volatile uint8_t *_ubrrl;
     volatile uint8_t *_ucsra;
@@ -46,29 +132,63 @@ class HardwareSerial : public Stream
     uint8_t _txen;
     uint8_t _rxcie;
     uint8_t _udrie;
+    uint8_t _txcie;
     uint8_t _u2x;
     bool transmitting;
-    serial_callback_t _transmit_complete_handler;
+    volatile bool _tx_hold;
+    void setBaud(unsigned long baud);
+    void setConfig(uint8_t config);
+    void enable(void);
   public:
     HardwareSerial(ring_buffer *rx_buffer, ring_buffer *tx_buffer,
+      receive_target *rx_target, serial_stats *stats, serial_handlers *handlers,
       volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
       volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
       volatile uint8_t *ucsrc, volatile uint8_t *udr,
-      uint8_t rxen, uint8_t txen, uint8_t rxcie, uint8_t udrie, uint8_t u2x);
+      uint8_t rxen, uint8_t txen, uint8_t rxcie, uint8_t udrie, uint8_t txcie,
+      uint8_t u2x);
     void begin(unsigned long);
     void begin(unsigned long, uint8_t);
+    // Same as begin(baud) and begin(baud, config), with the baud rate
+    // settings worked out and checked at compile time (see SerialBaud).
+    template <unsigned long BAUD> void begin(void)
+    {
+      setBaudSetting(SerialBaud<BAUD>::ubrr, SerialBaud<BAUD>::u2x);
+      enable();
+    }
+    template <unsigned long BAUD> void begin(uint8_t config)
+    {
+      setBaudSetting(SerialBaud<BAUD>::ubrr, SerialBaud<BAUD>::u2x);
+      setConfig(config);
+      enable();
+    }
+    void setBaudSetting(uint16_t baud_setting, bool use_u2x);
     void end();
     virtual int available(void);
     virtual int peek(void);
     virtual int read(void);
     virtual void flush(void);
     void flushReceiveBuffer(void);
+    size_t readBlock(uint8_t *buffer, size_t size);
+    size_t writeBlock(const uint8_t *buffer, size_t size);
+    size_t tryWrite(const uint8_t *buffer, size_t size);
+    int writeAvailable(void);
+    void holdTransmit(void);
+    void releaseTransmit(void);
     virtual size_t write(uint8_t);
     inline size_t write(unsigned long n) { return write((uint8_t)n); }
     inline size_t write(long n) { return write((uint8_t)n); }
     inline size_t write(unsigned int n) { return write((uint8_t)n); }
     inline size_t write(int n) { return write((uint8_t)n); }
+    void attachReceiveTarget(uint8_t *buffer, uint8_t size);
+    uint8_t detachReceiveTarget(void);
+    uint8_t receiveTargetCount(void);
+    // Called from the TXC interrupt once the transmit buffer has drained
+    // and the stop bit of the last byte has left the pin.
     void attachTransmitCompleteHandler(serial_callback_t cb);
+    void attachTransmitSpaceHandler(serial_callback_t cb);
+    void attachReceiveStartHandler(serial_callback_t cb);
+    void readStats(serial_stats *stats, bool clear);
     using Print::write; // pull in write(str) and write(buf, size) from Print
     operator bool();
 };
@@ -19,6 +19,11 @@
 #include "wdc_comm.h"
 
 /* Defines ------------------------------------------------------------------ */
+// Sensor sampling period.
+#define SAMPLE_PERIOD_MS        2
+
+/* Private Variables -------------------------------------------------------- */
+static uint32_t last_sample = 0;
 
 /* Arduino Setup Function --------------------------------------------------- */
 void setup()
@@ -32,7 +37,24 @@ void setup()
 /* Arduino Main Loop -------------------------------------------------------- */
 void loop()
 {
-  
+  int16_t sample[WDC_COMM_CHANNELS];
+  uint32_t now = millis();
+  uint8_t i;
+
+  //
+  // Read the sensor inputs and hand them to the WDC for batching.
+  //
+  if ((now - last_sample) >= SAMPLE_PERIOD_MS)
+  {
+    last_sample = now;
+    for (i = 0; i < WDC_COMM_CHANNELS; i++)
+    {
+      sample[i] = analogRead(A0 + i);
+    }
+    WDC_CommAddSample(sample, now);
+  }
+
+  WDC_CommTask(now);
 }
 
 /****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
@@ -0,0 +1,412 @@
+/**
+  ******************************************************************************
+  * @file    wdc_codec.c
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) sensor payload codec.
+  *
+  *          The decoder has no state beyond one payload, so the same file
+  *          builds for the host tools.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include <stddef.h>
+#include "wdc_codec.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define WDC_CODEC_BITPACK_WIDTH_IDX   1
+#define WDC_CODEC_BITPACK_COUNT_IDX   2
+
+// Zig-zag mapping of a 16-bit delta and its inverse.
+#define WDC_CODEC_ZIGZAG(d)     ((uint16_t)(((uint16_t)(d) << 1) ^ (uint16_t)((int16_t)(d) >> 15)))
+#define WDC_CODEC_UNZIGZAG(z)   ((uint16_t)(((z) >> 1) ^ (uint16_t)-((z) & 1)))
+
+/* Private Function Prototypes ---------------------------------------------- */
+static uint8_t WDC_CodecPutVarint(uint8_t *out, uint16_t value);
+static void WDC_CodecPutBits(uint8_t *buffer, uint16_t pos, uint16_t value,
+                             uint8_t bits);
+static uint16_t WDC_CodecGetBits(const uint8_t *buffer, uint16_t pos,
+                                 uint8_t bits);
+static uint8_t WDC_CodecDecodeVarint(const uint8_t *payload, uint8_t len,
+                                     int16_t *samples, uint8_t max_sets,
+                                     uint8_t nch);
+static uint8_t WDC_CodecDecodeBitpack(const uint8_t *payload, uint8_t len,
+                                      int16_t *samples, uint8_t max_sets,
+                                      uint8_t nch);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ * @brief   Start encoding sample sets into a payload buffer.
+ * @param   buffer: Payload buffer, e.g. WDC_DLL_DATA_PACKET_LEN - 1 bytes.
+ * @param   channels: Samples per set, 1 to WDC_CODEC_MAX_CHANNELS.
+ * @param   width: 0 for varints, or the bit-packed delta width (1 to 16).
+ *          Pick the smallest width that holds twice the largest expected
+ *          step; a larger step just starts a new payload.
+ * @retval  False if an argument is out of range.
+ */
+bool WDC_CodecEncoderInit(wdc_codec_encoder_t *enc, uint8_t *buffer,
+                          uint8_t size, uint8_t channels, uint8_t width)
+{
+  if ((channels == 0) || (channels > WDC_CODEC_MAX_CHANNELS) || (width > 16) ||
+      (size < (WDC_CODEC_BITPACK_HEADER_LEN + 2 * channels)))
+  {
+    return false;
+  }
+
+  enc->buffer = buffer;
+  enc->size = size;
+  enc->channels = channels;
+  enc->width = width;
+  WDC_CodecEncoderReset(enc);
+
+  return true;
+}
+
+/**
+ * @brief   Discard the encoded sets and start a new payload.
+ * @retval  None.
+ */
+void WDC_CodecEncoderReset(wdc_codec_encoder_t *enc)
+{
+  uint8_t i;
+
+  if (enc->width == 0)
+  {
+    enc->buffer[0] = WDC_CODEC_DELTA_VARINT | enc->channels;
+    enc->len = WDC_CODEC_HEADER_LEN;
+  }
+  else
+  {
+    enc->buffer[0] = WDC_CODEC_DELTA_BITPACK | enc->channels;
+    enc->buffer[WDC_CODEC_BITPACK_WIDTH_IDX] = enc->width;
+    enc->buffer[WDC_CODEC_BITPACK_COUNT_IDX] = 0;
+    enc->len = WDC_CODEC_BITPACK_HEADER_LEN;
+  }
+  enc->bitpos = (uint16_t)enc->len * 8;
+  enc->count = 0;
+  for (i = 0; i < enc->channels; i++)
+  {
+    enc->prev[i] = 0;
+  }
+}
+
+/**
+ * @brief   Append one sample set to the payload.
+ * @param   sample: One sample per channel.
+ * @retval  False if the set does not fit (or, bit-packed, a delta is wider
+ *          than the delta width). The payload is left as it was, so send
+ *          it (enc->len bytes), reset the encoder and try again.
+ */
+bool WDC_CodecEncodeSample(wdc_codec_encoder_t *enc, const int16_t *sample)
+{
+  uint8_t set[WDC_CODEC_MAX_CHANNELS * WDC_CODEC_VARINT_MAX_LEN];
+  uint16_t zz[WDC_CODEC_MAX_CHANNELS];
+  uint8_t bits = (enc->count == 0) ? 16 : enc->width;
+  uint8_t len = 0;
+  uint8_t i;
+
+  //
+  // Deltas wrap in 16 bits; the decoder wraps the same way.
+  //
+  for (i = 0; i < enc->channels; i++)
+  {
+    zz[i] = WDC_CODEC_ZIGZAG((uint16_t)sample[i] - (uint16_t)enc->prev[i]);
+  }
+
+  if (enc->width == 0)
+  {
+    for (i = 0; i < enc->channels; i++)
+    {
+      len += WDC_CodecPutVarint(&set[len], zz[i]);
+    }
+    if ((enc->len + len) > enc->size)
+    {
+      return false;
+    }
+    for (i = 0; i < len; i++)
+    {
+      enc->buffer[enc->len + i] = set[i];
+    }
+    enc->len += len;
+  }
+  else
+  {
+    if ((enc->count == 0xFF) ||
+        ((enc->bitpos + (uint16_t)bits * enc->channels) > ((uint16_t)enc->size * 8)))
+    {
+      return false;
+    }
+    if (enc->count == 0)
+    {
+      //
+      // The first set is raw so the payload stands alone.
+      //
+      for (i = 0; i < enc->channels; i++)
+      {
+        zz[i] = (uint16_t)sample[i];
+      }
+    }
+    else
+    {
+      for (i = 0; i < enc->channels; i++)
+      {
+        if ((bits < 16) && (zz[i] >= ((uint16_t)1 << bits)))
+        {
+          return false;
+        }
+      }
+    }
+    for (i = 0; i < enc->channels; i++)
+    {
+      WDC_CodecPutBits(enc->buffer, enc->bitpos, zz[i], bits);
+      enc->bitpos += bits;
+    }
+    enc->len = (uint8_t)((enc->bitpos + 7) / 8);
+    enc->buffer[WDC_CODEC_BITPACK_COUNT_IDX] = enc->count + 1;
+  }
+
+  for (i = 0; i < enc->channels; i++)
+  {
+    enc->prev[i] = sample[i];
+  }
+  enc->count++;
+
+  return true;
+}
+
+/**
+ * @brief   Decode a payload produced by the encoder.
+ * @param   samples: Receives the sample sets, channel 0 first.
+ * @param   max_sets: Room in samples, in sets.
+ * @param   channels: Set to the channel count. May be NULL.
+ * @retval  Number of sample sets decoded. 0 if the payload is malformed,
+ *          uses an unknown codec or holds more than max_sets sets.
+ */
+uint8_t WDC_CodecDecode(const uint8_t *payload, uint8_t len, int16_t *samples,
+                        uint8_t max_sets, uint8_t *channels)
+{
+  uint8_t nch;
+
+  if (len < WDC_CODEC_HEADER_LEN)
+  {
+    return 0;
+  }
+
+  nch = payload[0] & bmWDC_CODEC_HEADER_CHANNELS;
+  if (nch == 0)
+  {
+    return 0;
+  }
+  if (channels != NULL)
+  {
+    *channels = nch;
+  }
+
+  switch (payload[0] & bmWDC_CODEC_HEADER_CODEC)
+  {
+    case WDC_CODEC_DELTA_VARINT:
+      return WDC_CodecDecodeVarint(payload, len, samples, max_sets, nch);
+
+    case WDC_CODEC_DELTA_BITPACK:
+      return WDC_CodecDecodeBitpack(payload, len, samples, max_sets, nch);
+
+    default:
+      return 0;
+  }
+}
+
+/* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   Write a value as a varint: 7 bits per byte, least significant
+ *          first, top bit set on all but the last byte.
+ * @retval  Bytes written (1 to WDC_CODEC_VARINT_MAX_LEN).
+ */
+static uint8_t WDC_CodecPutVarint(uint8_t *out, uint16_t value)
+{
+  uint8_t len = 0;
+
+  while (value >= 0x80)
+  {
+    out[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[len++] = (uint8_t)value;
+
+  return len;
+}
+
+/**
+ * @brief   Write the low bits of value at a bit position, most significant
+ *          bit first.
+ * @note    Bits are written in order, so each byte is cleared when the
+ *          first bit lands in it.
+ * @retval  None.
+ */
+static void WDC_CodecPutBits(uint8_t *buffer, uint16_t pos, uint16_t value,
+                             uint8_t bits)
+{
+  uint8_t offset;
+  uint8_t take;
+
+  while (bits > 0)
+  {
+    offset = pos & 7;
+    take = 8 - offset;
+    if (take > bits)
+    {
+      take = bits;
+    }
+    if (offset == 0)
+    {
+      buffer[pos >> 3] = 0;
+    }
+    buffer[pos >> 3] |= (uint8_t)(((value >> (bits - take)) & ((1 << take) - 1)) <<
+                                  (8 - offset - take));
+    pos += take;
+    bits -= take;
+  }
+}
+
+/**
+ * @brief   Read bits written by WDC_CodecPutBits().
+ * @retval  The value.
+ */
+static uint16_t WDC_CodecGetBits(const uint8_t *buffer, uint16_t pos,
+                                 uint8_t bits)
+{
+  uint16_t value = 0;
+  uint8_t offset;
+  uint8_t take;
+
+  while (bits > 0)
+  {
+    offset = pos & 7;
+    take = 8 - offset;
+    if (take > bits)
+    {
+      take = bits;
+    }
+    value = (uint16_t)((value << take) |
+                       ((buffer[pos >> 3] >> (8 - offset - take)) & ((1 << take) - 1)));
+    pos += take;
+    bits -= take;
+  }
+
+  return value;
+}
+
+/**
+ * @brief   Decode a WDC_CODEC_DELTA_VARINT payload.
+ * @retval  Number of sample sets decoded, 0 if malformed.
+ */
+static uint8_t WDC_CodecDecodeVarint(const uint8_t *payload, uint8_t len,
+                                     int16_t *samples, uint8_t max_sets,
+                                     uint8_t nch)
+{
+  uint8_t pos = WDC_CODEC_HEADER_LEN;
+  uint8_t sets = 0;
+  uint8_t ch = 0;
+  uint8_t shift;
+  uint16_t value;
+  uint16_t prev;
+
+  while (pos < len)
+  {
+    if (sets >= max_sets)
+    {
+      return 0;
+    }
+
+    value = 0;
+    shift = 0;
+    do
+    {
+      if ((pos >= len) || (shift >= (7 * WDC_CODEC_VARINT_MAX_LEN)))
+      {
+        return 0;
+      }
+      value |= (uint16_t)(payload[pos] & 0x7F) << shift;
+      shift += 7;
+    } while (payload[pos++] & 0x80);
+
+    prev = (sets == 0) ? 0 : (uint16_t)samples[(sets - 1) * nch + ch];
+    samples[sets * nch + ch] = (int16_t)(uint16_t)(prev + WDC_CODEC_UNZIGZAG(value));
+
+    if (++ch == nch)
+    {
+      ch = 0;
+      sets++;
+    }
+  }
+
+  //
+  // A payload always ends on a whole set.
+  //
+  return (ch == 0) ? sets : 0;
+}
+
+/**
+ * @brief   Decode a WDC_CODEC_DELTA_BITPACK payload.
+ * @retval  Number of sample sets decoded, 0 if malformed.
+ */
+static uint8_t WDC_CodecDecodeBitpack(const uint8_t *payload, uint8_t len,
+                                      int16_t *samples, uint8_t max_sets,
+                                      uint8_t nch)
+{
+  uint8_t width;
+  uint8_t sets;
+  uint8_t bits;
+  uint8_t s;
+  uint8_t ch;
+  uint16_t pos = WDC_CODEC_BITPACK_HEADER_LEN * 8;
+  uint16_t value;
+
+  if (len < WDC_CODEC_BITPACK_HEADER_LEN)
+  {
+    return 0;
+  }
+
+  width = payload[WDC_CODEC_BITPACK_WIDTH_IDX];
+  sets = payload[WDC_CODEC_BITPACK_COUNT_IDX];
+  if ((width == 0) || (width > 16) || (sets > max_sets) ||
+      ((sets > 0) &&
+       ((pos + (uint16_t)nch * (16 + (uint16_t)(sets - 1) * width)) >
+        ((uint16_t)len * 8))))
+  {
+    return 0;
+  }
+
+  for (s = 0; s < sets; s++)
+  {
+    bits = (s == 0) ? 16 : width;
+    for (ch = 0; ch < nch; ch++)
+    {
+      value = WDC_CodecGetBits(payload, pos, bits);
+      pos += bits;
+      if (s == 0)
+      {
+        samples[ch] = (int16_t)value;
+      }
+      else
+      {
+        samples[s * nch + ch] = (int16_t)(uint16_t)((uint16_t)samples[(s - 1) * nch + ch] +
+                                                     WDC_CODEC_UNZIGZAG(value));
+      }
+    }
+  }
+
+  return sets;
+}
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,91 @@
+/**
+  ******************************************************************************
+  * @file    wdc_codec.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) sensor payload codec.
+  *
+  *          Packs multi-channel 16-bit samples into a data packet payload.
+  *          Each channel is delta encoded against its previous sample, so
+  *          slowly changing signals need far fewer than 16 bits per sample.
+  *          The deltas are zig-zag encoded (0, -1, 1, -2, ... become
+  *          0, 1, 2, 3, ...) and then written either as varints or
+  *          bit-packed at a fixed width.
+  *
+  *          Payload format:
+  *            Byte 0  - b7:4 codec, b3:0 channels.
+  *            WDC_CODEC_DELTA_VARINT:
+  *              Byte 1+ - Sample sets as varints, channel 0 first. The
+  *                        first set is encoded against 0.
+  *            WDC_CODEC_DELTA_BITPACK:
+  *              Byte 1  - Delta width in bits (1 to 16).
+  *              Byte 2  - Number of sample sets.
+  *              Byte 3+ - Bit stream, most significant bit first. The
+  *                        first set is raw 16-bit samples, then every
+  *                        delta takes exactly the delta width.
+  *          Every payload decodes on its own, even if an earlier one was
+  *          lost.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDC_CODEC_H__
+#define __WDC_CODEC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines ------------------------------------------------------------------ */
+#define WDC_CODEC_HEADER_LEN             1
+#define WDC_CODEC_BITPACK_HEADER_LEN     3
+#define bmWDC_CODEC_HEADER_CHANNELS      0x0F
+#define bmWDC_CODEC_HEADER_CODEC         0xF0
+#define WDC_CODEC_DELTA_VARINT           (1 << 4)
+#define WDC_CODEC_DELTA_BITPACK          (2 << 4)
+
+// Most channels per sample set.
+#define WDC_CODEC_MAX_CHANNELS           15
+
+// Most bytes a 16-bit zig-zag varint takes.
+#define WDC_CODEC_VARINT_MAX_LEN         3
+
+/* Exported Types ----------------------------------------------------------- */
+typedef struct
+{
+  uint8_t   *buffer;
+  uint8_t   size;
+  uint8_t   len;
+  uint8_t   channels;
+  uint8_t   width;
+  uint8_t   count;
+  uint16_t  bitpos;
+  int16_t   prev[WDC_CODEC_MAX_CHANNELS];
+} wdc_codec_encoder_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+bool      WDC_CodecEncoderInit(wdc_codec_encoder_t *enc, uint8_t *buffer,
+                               uint8_t size, uint8_t channels, uint8_t width);
+void      WDC_CodecEncoderReset(wdc_codec_encoder_t *enc);
+bool      WDC_CodecEncodeSample(wdc_codec_encoder_t *enc, const int16_t *sample);
+uint8_t   WDC_CodecDecode(const uint8_t *payload, uint8_t len, int16_t *samples,
+                          uint8_t max_sets, uint8_t *channels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WDC_CODEC_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
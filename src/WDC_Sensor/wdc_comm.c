@@ -19,12 +19,54 @@
 
 /* Includes ----------------------------------------------------------------- */
 #include "wdc_comm.h"
+#include "wdc_codec.h"
+#include "wdc_transport.h"
+#include "wdc_trace.h"
+#include "wdc_physical.h"
 
-/* Defines ------------------------------------------------------------------ */
+/* Private Types ------------------------------------------------------------ */
+//
+// Every layer's counters, in the order they are reported.
+//
+typedef struct
+{
+  pll_stats_t   pll;
+  dll_stats_t   dll;
+  tll_stats_t   tll;
+} comm_stats_t;
+
+#define WDC_COMM_STATS_COUNT          (sizeof(comm_stats_t) / sizeof(wdc_stat_t))
+
+// Most trace events sent in one reply.
+#define WDC_COMM_TRACE_HEADER_LEN     6
+#if !WDC_TRACE
+#define WDC_COMM_TRACE_MAX_EVENTS     0
+#elif (WDC_TRACE_DEPTH < ((WDC_TLL_MAX_MESSAGE_SIZE - WDC_COMM_TRACE_HEADER_LEN) / 4))
+#define WDC_COMM_TRACE_MAX_EVENTS     WDC_TRACE_DEPTH
+#else
+#define WDC_COMM_TRACE_MAX_EVENTS     ((WDC_TLL_MAX_MESSAGE_SIZE - WDC_COMM_TRACE_HEADER_LEN) / 4)
+#endif
 
 /* Private Variables -------------------------------------------------------- */
+//
+// Readings are batched into one transport segment, so each batch goes out
+// in a single bus frame.
+//
+static uint8_t comm_batch[WDC_TLL_SEGMENT_PAYLOAD];
+static wdc_codec_encoder_t comm_encoder;
+static uint32_t comm_batch_start = 0;
+
+// Requests from the base waiting to be answered.
+static bool comm_stats_requested = false;
+static bool comm_stats_clear = false;
+static bool comm_trace_requested = false;
 
 /* Private Function Prototypes ---------------------------------------------- */
+static bool WDC_CommFlush(void);
+static bool WDC_CommSendStats(void);
+static bool WDC_CommSendTrace(void);
+static void WDC_CommReceiveHandler(uint8_t endpoint, const uint8_t *message,
+                                   uint16_t len);
 
 /* Function Definitions ----------------------------------------------------- */
 /**
@@ -33,10 +75,195 @@
  */
 void WDC_CommInit(void)
 { 
-  // TODO
+  WDC_CodecEncoderInit(&comm_encoder, comm_batch, sizeof(comm_batch),
+                       WDC_COMM_CHANNELS, WDC_COMM_CODEC_WIDTH);
+
+  //
+  // Initialize the transport-link layer and the layers below it.
+  //
+  WDC_TLLInit();
+  WDC_TLLRegisterReceiveCallback(WDC_CommReceiveHandler);
+}
+
+/**
+ *  @brief  Run the communications protocol. Call from loop().
+ *  @param  now: Current time in milliseconds, e.g. millis().
+ *  @retval None.
+ */
+void WDC_CommTask(uint32_t now)
+{
+  //
+  // Answer the base before sending more readings.
+  //
+  if (comm_stats_requested && WDC_CommSendStats())
+  {
+    comm_stats_requested = false;
+  }
+  if (comm_trace_requested && WDC_CommSendTrace())
+  {
+    comm_trace_requested = false;
+  }
+
+  //
+  // Send a partial batch once its oldest reading reaches the deadline.
+  //
+  if ((comm_encoder.count > 0) &&
+      ((now - comm_batch_start) >= WDC_COMM_BATCH_DEADLINE_MS))
+  {
+    WDC_CommFlush();
+  }
+
+  WDC_TLLTask();
+}
+
+/**
+ *  @brief  Add one reading to the current batch.
+ *  @note   When the reading does not fit, the batch is sent and the reading
+ *          starts the next one.
+ *  @param  sample: WDC_COMM_CHANNELS samples.
+ *  @param  now: Current time in milliseconds, e.g. millis().
+ *  @retval False if the batch is full and the transport layer cannot take
+ *          it yet. The reading is not stored.
+ */
+bool WDC_CommAddSample(const int16_t *sample, uint32_t now)
+{
+  if (!WDC_CodecEncodeSample(&comm_encoder, sample))
+  {
+    if (!WDC_CommFlush())
+    {
+      return false;
+    }
+    WDC_CodecEncodeSample(&comm_encoder, sample);
+  }
+
+  if (comm_encoder.count == 1)
+  {
+    comm_batch_start = now;
+  }
+
+  return true;
 }
 
 /* Private Function Definitions --------------------------------------------- */
+/**
+ *  @brief  Send the current batch and start a new one.
+ *  @retval False if the transport layer is still busy with the last one.
+ */
+static bool WDC_CommFlush(void)
+{
+  if (!WDC_TLLSendMessage(WDC_DLL_ENDPOINT_INPUT, comm_batch, comm_encoder.len))
+  {
+    return false;
+  }
+
+  WDC_CodecEncoderReset(&comm_encoder);
+
+  return true;
+}
+
+/**
+ *  @brief  Send every layer's statistics counters on the control endpoint.
+ *  @retval False if the transport layer is busy. Nothing is reset.
+ */
+static bool WDC_CommSendStats(void)
+{
+  uint8_t reply[2 + 2 * WDC_COMM_STATS_COUNT];
+  comm_stats_t stats;
+  const wdc_stat_t *counter = (const wdc_stat_t *)&stats;
+  uint8_t i;
+
+  //
+  // Read (and reset) the counters only once the reply is sure to go out.
+  //
+  if (!WDC_TLLCanSend())
+  {
+    return false;
+  }
+
+  WDC_PLLReadStats(&stats.pll, comm_stats_clear);
+  WDC_DLLReadStats(&stats.dll, comm_stats_clear);
+  WDC_TLLReadStats(&stats.tll, comm_stats_clear);
+
+  reply[0] = WDC_COMM_CONTROL_GET_STATS;
+  reply[1] = WDC_COMM_STATS_COUNT;
+  for (i = 0; i < WDC_COMM_STATS_COUNT; i++)
+  {
+    reply[2 + 2 * i] = (uint8_t)(counter[i] >> 8);
+    reply[3 + 2 * i] = (uint8_t)counter[i];
+  }
+
+  return WDC_TLLSendMessage(WDC_DLL_ENDPOINT_CONTROL, reply, sizeof(reply));
+}
+
+/**
+ *  @brief  Send the oldest trace events on the control endpoint.
+ *  @retval False if the transport layer is busy. Nothing is taken out of
+ *          the trace.
+ */
+static bool WDC_CommSendTrace(void)
+{
+  uint8_t reply[WDC_COMM_TRACE_HEADER_LEN + 4 * WDC_COMM_TRACE_MAX_EVENTS];
+  uint8_t count = 0;
+#if WDC_TRACE
+  wdc_trace_entry_t entry;
+  uint8_t *dst;
+#endif
+
+  if (!WDC_TLLCanSend())
+  {
+    return false;
+  }
+
+  reply[0] = WDC_COMM_CONTROL_GET_TRACE;
+  reply[1] = (uint8_t)((uint32_t)WDC_TRACE_TICKS_PER_MS >> 24);
+  reply[2] = (uint8_t)((uint32_t)WDC_TRACE_TICKS_PER_MS >> 16);
+  reply[3] = (uint8_t)((uint32_t)WDC_TRACE_TICKS_PER_MS >> 8);
+  reply[4] = (uint8_t)WDC_TRACE_TICKS_PER_MS;
+
+#if WDC_TRACE
+  while ((count < WDC_COMM_TRACE_MAX_EVENTS) && WDC_TraceRead(&entry, 1))
+  {
+    dst = &reply[WDC_COMM_TRACE_HEADER_LEN + 4 * count];
+    dst[0] = entry.event;
+    dst[1] = entry.arg;
+    dst[2] = (uint8_t)(entry.ticks >> 8);
+    dst[3] = (uint8_t)entry.ticks;
+    count++;
+  }
+#endif
+  reply[5] = count;
+
+  return WDC_TLLSendMessage(WDC_DLL_ENDPOINT_CONTROL, reply,
+                            WDC_COMM_TRACE_HEADER_LEN + 4 * count);
+}
+
+/**
+ *  @brief  Handler for messages from the base.
+ *  @retval None.
+ */
+static void WDC_CommReceiveHandler(uint8_t endpoint, const uint8_t *message,
+                                   uint16_t len)
+{
+  if ((endpoint != WDC_DLL_ENDPOINT_CONTROL) || (len == 0))
+  {
+    return;
+  }
+
+  switch (message[0])
+  {
+    case WDC_COMM_CONTROL_GET_STATS:
+      comm_stats_requested = true;
+      comm_stats_clear = (len > 1) && (message[1] & bmWDC_COMM_STATS_CLEAR);
+      break;
+
+    case WDC_COMM_CONTROL_GET_TRACE:
+      comm_trace_requested = true;
+      break;
+
+    default:
+      break;
+  }
+}
 
 /****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
 
@@ -28,9 +28,55 @@ extern "C" {
 #include <stdbool.h>
 
 /* Defines ------------------------------------------------------------------ */
+// Samples per reading (e.g. one per sensor axis).
+#ifndef WDC_COMM_CHANNELS
+#define WDC_COMM_CHANNELS             3
+#endif
+
+// Longest a reading may wait in a batch before the batch is sent anyway.
+#ifndef WDC_COMM_BATCH_DEADLINE_MS
+#define WDC_COMM_BATCH_DEADLINE_MS    20
+#endif
+
+// Payload codec (see wdc_codec.h): 0 for delta varints, or the bit-packed
+// delta width.
+#ifndef WDC_COMM_CODEC_WIDTH
+#define WDC_COMM_CODEC_WIDTH          0
+#endif
+
+//
+// Control Endpoint Messages
+// Byte 0:
+//   Command. The reply starts with the same byte.
+//
+// WDC_COMM_CONTROL_GET_STATS
+//   Request Byte 1 (optional):
+//     b0   - Reset the counters once they have been sent.
+//   Reply Byte 1:
+//     Number of counters that follow.
+//   Reply Byte 2+:
+//     Counters, 16 bits each, most significant byte first, in the field
+//     order of pll_stats_t, then dll_stats_t, then tll_stats_t. A counter
+//     at 0xFFFF has saturated.
+//
+// WDC_COMM_CONTROL_GET_TRACE
+//   Takes the oldest events out of the trace ring (see wdc_trace.h).
+//   Reply Byte 1-4:
+//     Timestamp ticks per millisecond, most significant byte first.
+//   Reply Byte 5:
+//     Number of events that follow. 0 if tracing is not built in.
+//   Reply Byte 6+:
+//     Events, 4 bytes each: event, argument, timestamp (16 bits, most
+//     significant byte first).
+//
+#define WDC_COMM_CONTROL_GET_STATS    0x01
+#define WDC_COMM_CONTROL_GET_TRACE    0x02
+#define bmWDC_COMM_STATS_CLEAR        (1 << 0)
 
 /* Function Prototypes  ----------------------------------------------------- */
 void WDC_CommInit(void);
+void WDC_CommTask(uint32_t now);
+bool WDC_CommAddSample(const int16_t *sample, uint32_t now);
 
 #ifdef __cplusplus
 }
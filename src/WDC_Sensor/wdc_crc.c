@@ -0,0 +1,141 @@
+/**
+  ******************************************************************************
+  * @file    wdc_crc.c
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    15-Sep-2014
+  * @brief   CRC-8 and CRC-16 routines for the WDC data-link frame check.
+  *
+  *          The lookup tables are generated by the preprocessor from the
+  *          polynomials in wdc_crc.h and live in flash on AVR. The bitwise
+  *          versions need no table and are kept as a reference.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include "wdc_crc.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+#endif
+
+/* Defines ------------------------------------------------------------------ */
+//
+// One shift of the CRC register, MSB first. The feedback bit is multiplied
+// into the polynomial so each step names its argument only twice, which
+// keeps the expansion of eight nested steps small.
+//
+#define WDC_CRC8_STEP(c)        ((((c) << 1) ^ (((c) >> 7) * WDC_CRC8_POLY)) & 0xFF)
+#define WDC_CRC16_STEP(c)       ((((c) << 1) ^ (((c) >> 15) * WDC_CRC16_POLY)) & 0xFFFF)
+
+#define WDC_CRC_STEP8(S, c)     S(S(S(S(S(S(S(S(c))))))))
+
+#define WDC_CRC8_ENTRY(i)       WDC_CRC_STEP8(WDC_CRC8_STEP, (i))
+#define WDC_CRC16_ENTRY(i)      WDC_CRC_STEP8(WDC_CRC16_STEP, ((unsigned long)(i) << 8))
+
+#define WDC_CRC_TABLE4(T, n)    T(n), T((n) + 1), T((n) + 2), T((n) + 3)
+#define WDC_CRC_TABLE16(T, n)   WDC_CRC_TABLE4(T, n), WDC_CRC_TABLE4(T, (n) + 4), \
+                                WDC_CRC_TABLE4(T, (n) + 8), WDC_CRC_TABLE4(T, (n) + 12)
+#define WDC_CRC_TABLE64(T, n)   WDC_CRC_TABLE16(T, n), WDC_CRC_TABLE16(T, (n) + 16), \
+                                WDC_CRC_TABLE16(T, (n) + 32), WDC_CRC_TABLE16(T, (n) + 48)
+#define WDC_CRC_TABLE256(T)     WDC_CRC_TABLE64(T, 0), WDC_CRC_TABLE64(T, 64), \
+                                WDC_CRC_TABLE64(T, 128), WDC_CRC_TABLE64(T, 192)
+
+/* Private Variables -------------------------------------------------------- */
+static const uint8_t crc8_table[256] PROGMEM =
+{
+  WDC_CRC_TABLE256(WDC_CRC8_ENTRY)
+};
+
+static const uint16_t crc16_table[256] PROGMEM =
+{
+  WDC_CRC_TABLE256(WDC_CRC16_ENTRY)
+};
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ * @brief   Table-driven CRC-8.
+ * @param   crc: WDC_CRC8_INIT, or the result of a previous call.
+ * @retval  Updated CRC.
+ */
+uint8_t WDC_CRC8(uint8_t crc, const uint8_t *data, uint16_t len)
+{
+  while (len--)
+  {
+    crc = pgm_read_byte(&crc8_table[crc ^ *data++]);
+  }
+
+  return crc;
+}
+
+/**
+ * @brief   Bitwise CRC-8. Same result as WDC_CRC8().
+ * @retval  Updated CRC.
+ */
+uint8_t WDC_CRC8Bitwise(uint8_t crc, const uint8_t *data, uint16_t len)
+{
+  uint8_t bit;
+
+  while (len--)
+  {
+    crc ^= *data++;
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ WDC_CRC8_POLY)
+                         : (uint8_t)(crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+/**
+ * @brief   Table-driven CRC-16.
+ * @param   crc: WDC_CRC16_INIT, or the result of a previous call.
+ * @retval  Updated CRC.
+ */
+uint16_t WDC_CRC16(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+  while (len--)
+  {
+    crc = (crc << 8) ^ pgm_read_word(&crc16_table[(crc >> 8) ^ *data++]);
+  }
+
+  return crc;
+}
+
+/**
+ * @brief   Bitwise CRC-16. Same result as WDC_CRC16().
+ * @retval  Updated CRC.
+ */
+uint16_t WDC_CRC16Bitwise(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+  uint8_t bit;
+
+  while (len--)
+  {
+    crc ^= (uint16_t)*data++ << 8;
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ WDC_CRC16_POLY)
+                           : (uint16_t)(crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file    wdc_crc.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    15-Sep-2014
+  * @brief   CRC-8 and CRC-16 routines for the WDC data-link frame check.
+  *
+  *          CRC-8:  polynomial 0x07, initial value 0x00 (CRC-8/SMBUS).
+  *          CRC-16: polynomial 0x1021, initial value 0xFFFF
+  *                  (CRC-16/CCITT-FALSE).
+  *          Neither is reflected or has a final XOR, so running the CRC over
+  *          a frame followed by its CRC (most significant byte first) gives 0.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDC_CRC_H__
+#define __WDC_CRC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines ------------------------------------------------------------------ */
+#define WDC_CRC8_POLY             0x07
+#define WDC_CRC8_INIT             0x00
+#define WDC_CRC16_POLY            0x1021
+#define WDC_CRC16_INIT            0xFFFF
+
+/* Function Prototypes ------------------------------------------------------ */
+uint8_t   WDC_CRC8(uint8_t crc, const uint8_t *data, uint16_t len);
+uint8_t   WDC_CRC8Bitwise(uint8_t crc, const uint8_t *data, uint16_t len);
+uint16_t  WDC_CRC16(uint16_t crc, const uint8_t *data, uint16_t len);
+uint16_t  WDC_CRC16Bitwise(uint16_t crc, const uint8_t *data, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WDC_CRC_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -18,49 +18,176 @@
 
 
 /* Includes ----------------------------------------------------------------- */
+#include <stddef.h>
+#include <string.h>
 #include "wdc_datalink.h"
-#include "wdcuart_physical.h" // Change this depending on the desired PHY layer.
+#include "wdc_crc.h"
+#include "wdc_trace.h"
+#include "wdc_physical.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#endif
 
 /* Defines ------------------------------------------------------------------ */
-#define WDC_DLL_QUEUE_SIZE      4
+// Depth of each transmit lane. Each must be a power of two.
+#define WDC_DLL_ENUMERATION_QUEUE_SIZE  2
+#define WDC_DLL_REQUEST_QUEUE_SIZE      2
+#define WDC_DLL_DATA_QUEUE_SIZE         4
+#define WDC_DLL_EVENT_QUEUE_SIZE        2
 
-/* Exported Types ----------------------------------------------------------- */
-typedef struct
-{
-  // Note: Must be a packed data structure.
-  uint8_t   header;
-  uint8_t   payload[WDC_DLL_ENUMERATION_PACKET_LEN - 1];
-} dll_enumeration_packet_t;
+// Transmit lanes, in priority order.
+#define WDC_DLL_LANE_ENUMERATION        0
+#define WDC_DLL_LANE_EVENT              1
+#define WDC_DLL_LANE_REQUEST            2
+#define WDC_DLL_LANE_DATA               3
+#define WDC_DLL_LANE_COUNT              4
+
+#define WDC_DLL_BAUD_NONE               WDC_PLL_BAUD_NONE
+
+//
+// Receive dispatch. Every header byte maps to a handler slot through a
+// table in flash; slot 0 is every header no base sends (companion-to-base,
+// the reserved endpoint, or a reserved bit set), the others are one per
+// packet type and each of the three usable endpoints.
+//
+#define WDC_DLL_SLOT_REJECT             0
+#define WDC_DLL_SLOT(type, endpoint)    (1 + (type) * 3 + (endpoint))
+#define WDC_DLL_SLOT_COUNT              WDC_DLL_SLOT(WDC_DLL_PACKET_TYPE_EVENT + 1, 0)
+
+#define WDC_DLL_SLOT_ENTRY(h) \
+  ((((h) & bmWDC_DLL_HEADER_RESERVED) || \
+    (((h) & bmWDC_DLL_HEADER_DIRN) != bmWDC_DLL_HEADER_DIRN_B2C) || \
+    (((h) & bmWDC_DLL_HEADER_ENDPOINT) == WDC_DLL_ENDPOINT_RESERVED)) ? \
+   WDC_DLL_SLOT_REJECT : \
+   WDC_DLL_SLOT(((h) & bmWDC_DLL_HEADER_PACKET_TYPE) >> \
+                WDC_DLL_HEADER_PACKET_TYPE_POS, \
+                (h) & bmWDC_DLL_HEADER_ENDPOINT))
+
+#define WDC_DLL_TABLE4(T, n)    T(n), T((n) + 1), T((n) + 2), T((n) + 3)
+#define WDC_DLL_TABLE16(T, n)   WDC_DLL_TABLE4(T, n), WDC_DLL_TABLE4(T, (n) + 4), \
+                                WDC_DLL_TABLE4(T, (n) + 8), WDC_DLL_TABLE4(T, (n) + 12)
+#define WDC_DLL_TABLE64(T, n)   WDC_DLL_TABLE16(T, n), WDC_DLL_TABLE16(T, (n) + 16), \
+                                WDC_DLL_TABLE16(T, (n) + 32), WDC_DLL_TABLE16(T, (n) + 48)
+#define WDC_DLL_TABLE256(T)     WDC_DLL_TABLE64(T, 0), WDC_DLL_TABLE64(T, 64), \
+                                WDC_DLL_TABLE64(T, 128), WDC_DLL_TABLE64(T, 192)
+
+#if (WDC_DLL_MAX_FRAME_SIZE > WDC_PLL_MAX_FRAME_SIZE)
+#error "The PHY cannot receive a full data-link frame."
+#endif
+
+#if (WDC_DLL_CRC != 0) && (WDC_DLL_CRC != 8) && (WDC_DLL_CRC != 16)
+#error "WDC_DLL_CRC must be 0, 8 or 16."
+#endif
+
+// Size of a frame on the wire: the packet plus the CRC trailer.
+#define WDC_DLL_FRAME_LEN(packet_len)   ((packet_len) + WDC_DLL_CRC_LEN)
 
+//
+// Compile-time check. Fails with a negative array size if cond is false.
+//
+#define WDC_DLL_STATIC_ASSERT(cond, name) \
+  typedef char wdc_dll_static_assert_##name[(cond) ? 1 : -1]
+
+WDC_DLL_STATIC_ASSERT(sizeof(dll_enumeration_packet_t) ==
+                      WDC_DLL_ENUMERATION_PACKET_LEN, enumeration_size);
+WDC_DLL_STATIC_ASSERT(sizeof(dll_request_packet_t) ==
+                      WDC_DLL_REQUEST_PACKET_LEN, request_size);
+WDC_DLL_STATIC_ASSERT(sizeof(dll_data_packet_t) ==
+                      WDC_DLL_DATA_PACKET_LEN, data_size);
+WDC_DLL_STATIC_ASSERT(sizeof(dll_event_packet_t) ==
+                      WDC_DLL_EVENT_PACKET_LEN, event_size);
+WDC_DLL_STATIC_ASSERT(offsetof(dll_data_packet_t, header) ==
+                      WDC_DLL_HEADER_IDX, header_offset);
+WDC_DLL_STATIC_ASSERT(offsetof(dll_data_packet_t, payload) ==
+                      WDC_DLL_HEADER_IDX + 1, payload_offset);
+WDC_DLL_STATIC_ASSERT(WDC_DLL_FRAME_LEN(WDC_DLL_DATA_PACKET_LEN) <=
+                      WDC_DLL_MAX_FRAME_SIZE, frame_size);
+
+/* Private Types ------------------------------------------------------------ */
+//
+// A transmit lane is a queue of fixed-size packet slots. The application
+// side fills slots at the head; WDC_DLLStagePacket() sends from the tail.
+// Indices are free-running 8-bit counters.
+//
 typedef struct
 {
-  // Note: Must be a packed data structure.
-  uint8_t   header;
-  uint8_t   payload[WDC_DLL_REQUEST_PACKET_LEN - 1];
-} dll_request_packet_t;
+  uint8_t           *slots;
+  uint8_t           *lens;
+  uint8_t           slot_size;
+  uint8_t           mask;
+  volatile uint8_t  head;
+  volatile uint8_t  tail;
+} dll_tx_lane_t;
 
-typedef struct
+#define DLL_TX_LANE(slots, lens) \
+  { (uint8_t *)(slots), (lens), sizeof((slots)[0]), sizeof(lens) - 1, 0, 0 }
+
+/* Private Variables -------------------------------------------------------- */
+static uint8_t dll_tx_enumeration[WDC_DLL_ENUMERATION_QUEUE_SIZE]
+                                 [WDC_DLL_FRAME_LEN(WDC_DLL_ENUMERATION_PACKET_LEN)];
+static uint8_t dll_tx_request[WDC_DLL_REQUEST_QUEUE_SIZE]
+                             [WDC_DLL_FRAME_LEN(WDC_DLL_REQUEST_PACKET_LEN)];
+static uint8_t dll_tx_data[WDC_DLL_DATA_QUEUE_SIZE]
+                          [WDC_DLL_FRAME_LEN(WDC_DLL_DATA_PACKET_LEN)];
+static uint8_t dll_tx_event[WDC_DLL_EVENT_QUEUE_SIZE]
+                           [WDC_DLL_FRAME_LEN(WDC_DLL_EVENT_PACKET_LEN)];
+static uint8_t dll_tx_enumeration_len[WDC_DLL_ENUMERATION_QUEUE_SIZE];
+static uint8_t dll_tx_request_len[WDC_DLL_REQUEST_QUEUE_SIZE];
+static uint8_t dll_tx_data_len[WDC_DLL_DATA_QUEUE_SIZE];
+static uint8_t dll_tx_event_len[WDC_DLL_EVENT_QUEUE_SIZE];
+
+static dll_tx_lane_t dll_tx_lanes[WDC_DLL_LANE_COUNT] =
 {
-  // Note: Must be a packed data structure.
-  uint8_t   header;
-  uint8_t   payload[WDC_DLL_DATA_PACKET_LEN - 1];
-} dll_data_packet_t;
+  DLL_TX_LANE(dll_tx_enumeration, dll_tx_enumeration_len),
+  DLL_TX_LANE(dll_tx_event, dll_tx_event_len),
+  DLL_TX_LANE(dll_tx_request, dll_tx_request_len),
+  DLL_TX_LANE(dll_tx_data, dll_tx_data_len),
+};
 
-typedef struct
+// Lane whose tail packet is staged in or being sent by the PHY.
+static dll_tx_lane_t *dll_tx_inflight = NULL;
+
+//
+// Handler slot of every header byte, and the handler in each slot.
+// Slot WDC_DLL_SLOT_REJECT stays NULL; every other slot has a handler,
+// WDC_DLLDiscardHandler() if nothing is registered.
+//
+static const uint8_t dll_dispatch_slot[256] PROGMEM =
 {
-  // Note: Must be a packed data structure.
-  uint8_t   header;
-  uint8_t   payload[WDC_DLL_EVENT_PACKET_LEN - 1];
-} dll_event_packet_t;
+  WDC_DLL_TABLE256(WDC_DLL_SLOT_ENTRY)
+};
+static dll_receive_callback_t dll_handlers[WDC_DLL_SLOT_COUNT];
 
-/* Private Variables -------------------------------------------------------- */
-static uint8_t dll_generic_packet[WDC_DLL_MAX_FRAME_SIZE];
-static dll_enumeration_packet_t dll_tx_queue[WDC_DLL_QUEUE_SIZE];
-static dll_enumeration_packet_t dll_rx_queue[WDC_DLL_QUEUE_SIZE];
+// Number of bus frames seen, for timeouts in the layers above.
+static volatile uint8_t dll_frame_count = 0;
+
+static dll_stats_t dll_stats;
+
+//
+// Baud rate switch accepted over enumeration. It is handed to the PHY
+// together with the enumeration lane packet numbered dll_baud_after - 1
+// (the reply).
+//
+static uint8_t dll_baud_pending = WDC_DLL_BAUD_NONE;
+static uint8_t dll_baud_after = 0;
 
 /* Private Function Prototypes ---------------------------------------------- */
+static bool WDC_DLLQueuePacket(dll_tx_lane_t *lane, uint8_t type,
+                               uint8_t endpoint, const uint8_t *payload,
+                               uint8_t len);
+static uint8_t WDC_DLLAppendCrc(uint8_t *frame, uint8_t len);
+static bool WDC_DLLCheckCrc(const uint8_t *frame, uint8_t len);
+static void WDC_DLLStagePacket(void);
 static void WDC_DLLStartOfFrameHandler(void);
 static void WDC_DLLEndOfFrameHandler(void);
+static void WDC_DLLEnumerationHandler(uint8_t type, uint8_t endpoint,
+                                      const uint8_t *payload, uint8_t len);
+static void WDC_DLLDiscardHandler(uint8_t type, uint8_t endpoint,
+                                  const uint8_t *payload, uint8_t len);
 
 /* Function Definitions ----------------------------------------------------- */
 /**
@@ -70,6 +197,29 @@ static void WDC_DLLEndOfFrameHandler(void);
  */
 void WDC_DLLInit(void)
 {
+  uint8_t i;
+
+  for (i = 0; i < WDC_DLL_LANE_COUNT; i++)
+  {
+    dll_tx_lanes[i].head = 0;
+    dll_tx_lanes[i].tail = 0;
+  }
+  dll_tx_inflight = NULL;
+  dll_baud_pending = WDC_DLL_BAUD_NONE;
+
+  //
+  // Enumeration on the control endpoint is handled here and cannot be
+  // registered for. Everything else a base sends is dropped until the
+  // layers above register for it.
+  //
+  dll_handlers[WDC_DLL_SLOT_REJECT] = NULL;
+  for (i = WDC_DLL_SLOT_REJECT + 1; i < WDC_DLL_SLOT_COUNT; i++)
+  {
+    dll_handlers[i] = WDC_DLLDiscardHandler;
+  }
+  dll_handlers[WDC_DLL_SLOT(WDC_DLL_PACKET_TYPE_ENUMERATION,
+                            WDC_DLL_ENDPOINT_CONTROL)] = WDC_DLLEnumerationHandler;
+
   //
   // Initialize the physical-link layer of the WDC communication protocol.
   //
@@ -89,56 +239,320 @@ void WDC_DLLInit(void)
  */
 void WDC_DLLDeinit(void)
 {
-  // TODO
+  uint8_t i;
+
+  //
+  // Take the physical-link layer down first, so no frame callback runs
+  // while the queues are cleared.
+  //
+  WDC_PLLDeinit();
+
+  for (i = 0; i < WDC_DLL_LANE_COUNT; i++)
+  {
+    dll_tx_lanes[i].head = 0;
+    dll_tx_lanes[i].tail = 0;
+  }
+  dll_tx_inflight = NULL;
+  dll_baud_pending = WDC_DLL_BAUD_NONE;
+
+  //
+  // Drop every registered handler, enumeration included.
+  //
+  for (i = WDC_DLL_SLOT_REJECT + 1; i < WDC_DLL_SLOT_COUNT; i++)
+  {
+    dll_handlers[i] = WDC_DLLDiscardHandler;
+  }
 }
 
 /**
- * @brief   
- * @retval  
+ * @brief   Data-link layer bottom half. Call from the main loop.
+ * @note    Runs the frame handlers deferred by the PHY interrupt and
+ *          stages the next packet as soon as the PHY is free, so it goes
+ *          out at the very start of the next frame.
+ * @retval  None.
  */
-bool WDC_DLLDataTransmitEnumerationPacket(uint8_t *payload)
+void WDC_DLLTask(void)
 {
+  WDC_PLLTask();
+  WDC_DLLStagePacket();
+}
 
+/**
+ * @brief   Queue an enumeration packet for the next bus frame.
+ * @param   endpoint: Endpoint the packet belongs to.
+ * @param   payload: Packet payload, without the header byte.
+ * @param   len: Payload length. At most WDC_DLL_ENUMERATION_PACKET_LEN - 1.
+ * @retval  True if the packet was queued. False if it is too long or the
+ *          enumeration lane is full.
+ */
+bool WDC_DLLDataTransmitEnumerationPacket(uint8_t endpoint, const uint8_t *payload,
+                                          uint8_t len)
+{
+  return WDC_DLLQueuePacket(&dll_tx_lanes[WDC_DLL_LANE_ENUMERATION],
+                            WDC_DLL_PACKET_TYPE_ENUMERATION, endpoint,
+                            payload, len);
 }
 
 /**
- * @brief   
- * @retval  
+ * @brief   Queue a request packet for the next bus frame.
+ * @param   endpoint: Endpoint the packet belongs to.
+ * @param   payload: Packet payload, without the header byte.
+ * @param   len: Payload length. At most WDC_DLL_REQUEST_PACKET_LEN - 1.
+ * @retval  True if the packet was queued. False if it is too long or the
+ *          request lane is full.
  */
-bool WDC_DLLDataTransmitRequestPacket(uint8_t *payload)
+bool WDC_DLLDataTransmitRequestPacket(uint8_t endpoint, const uint8_t *payload,
+                                      uint8_t len)
 {
+  return WDC_DLLQueuePacket(&dll_tx_lanes[WDC_DLL_LANE_REQUEST],
+                            WDC_DLL_PACKET_TYPE_REQUEST, endpoint,
+                            payload, len);
+}
 
+/**
+ * @brief   Queue a data packet for the next bus frame.
+ * @param   endpoint: Endpoint the packet belongs to.
+ * @param   payload: Packet payload, without the header byte.
+ * @param   len: Payload length. At most WDC_DLL_DATA_PACKET_LEN - 1.
+ * @retval  True if the packet was queued. False if it is too long or the
+ *          data lane is full.
+ */
+bool WDC_DLLDataTransmitDataPacket(uint8_t endpoint, const uint8_t *payload,
+                                   uint8_t len)
+{
+  return WDC_DLLQueuePacket(&dll_tx_lanes[WDC_DLL_LANE_DATA],
+                            WDC_DLL_PACKET_TYPE_DATA, endpoint,
+                            payload, len);
 }
 
 /**
- * @brief   
- * @retval  
+ * @brief   Queue an event packet for the next bus frame.
+ * @param   endpoint: Endpoint the packet belongs to.
+ * @param   payload: Packet payload, without the header byte.
+ * @param   len: Payload length. At most WDC_DLL_EVENT_PACKET_LEN - 1.
+ * @retval  True if the packet was queued. False if it is too long or the
+ *          event lane is full.
  */
-bool WDC_DLLDataTransmitDataPacket(uint8_t *payload)
+bool WDC_DLLDataTransmitEventPacket(uint8_t endpoint, const uint8_t *payload,
+                                    uint8_t len)
 {
+  return WDC_DLLQueuePacket(&dll_tx_lanes[WDC_DLL_LANE_EVENT],
+                            WDC_DLL_PACKET_TYPE_EVENT, endpoint,
+                            payload, len);
+}
 
+/**
+ * @brief   Number of bus frames seen so far.
+ * @note    Wraps at 256. Compare counts by subtraction.
+ * @retval  Frame count.
+ */
+uint8_t WDC_DLLFrameCount(void)
+{
+  return dll_frame_count;
 }
 
 /**
- * @brief   
- * @retval  
+ * @brief   Register the handler for received packets of one type on one
+ *          endpoint.
+ * @note    Call after WDC_DLLInit(), which clears the registrations.
+ * @param   cb: Handler, or NULL to drop those packets again.
+ * @retval  False for the reserved endpoint and for enumeration on the
+ *          control endpoint, which the data-link layer handles itself.
  */
-bool WDC_DLLDataTransmitEventPacket(uint8_t *payload)
+bool WDC_DLLRegisterHandler(uint8_t type, uint8_t endpoint,
+                            dll_receive_callback_t cb)
 {
+  if ((type > WDC_DLL_PACKET_TYPE_EVENT) ||
+      (endpoint >= WDC_DLL_ENDPOINT_RESERVED) ||
+      ((type == WDC_DLL_PACKET_TYPE_ENUMERATION) &&
+       (endpoint == WDC_DLL_ENDPOINT_CONTROL)))
+  {
+    return false;
+  }
+
+  dll_handlers[WDC_DLL_SLOT(type, endpoint)] =
+    (cb != NULL) ? cb : WDC_DLLDiscardHandler;
+  return true;
+}
 
+/**
+ * @brief   Read the data-link statistics.
+ * @param   clear: Reset the counters after reading them.
+ * @retval  None.
+ */
+void WDC_DLLReadStats(dll_stats_t *stats, bool clear)
+{
+  *stats = dll_stats;
+  if (clear)
+  {
+    memset(&dll_stats, 0, sizeof(dll_stats));
+  }
 }
 
 /* Private Function Definitions --------------------------------------------- */
 /**
- * @brief   Handler for WDC frames.
+ * @brief   Copy a companion-to-base packet into a free slot of a lane.
+ * @retval  True if the packet was queued.
+ */
+static bool WDC_DLLQueuePacket(dll_tx_lane_t *lane, uint8_t type,
+                               uint8_t endpoint, const uint8_t *payload,
+                               uint8_t len)
+{
+  uint8_t idx = lane->head & lane->mask;
+  uint8_t *slot = &lane->slots[idx * lane->slot_size];
+
+  if (len >= (lane->slot_size - WDC_DLL_CRC_LEN))
+  {
+    return false;
+  }
+
+  if ((uint8_t)(lane->head - lane->tail) > lane->mask)
+  {
+    WDC_STAT_INC(dll_stats.tx_lane_full);
+    return false;
+  }
+
+  slot[WDC_DLL_HEADER_IDX] = WDC_DLLHeaderEncode(WDC_DLL_DIRN_C2B, type,
+                                                 endpoint);
+  if (len > 0)
+  {
+    memcpy(&slot[WDC_DLL_HEADER_IDX + 1], payload, len);
+  }
+  lane->lens[idx] = WDC_DLLAppendCrc(slot, len + 1);
+
+  //
+  // Publish the slot last, then stage it straight away if the PHY is
+  // idle.
+  //
+  lane->head++;
+  WDC_DLLStagePacket();
+
+  return true;
+}
+
+/**
+ * @brief   Append the CRC trailer (if enabled) to a frame.
+ * @param   len: Length of the frame without the trailer.
+ * @retval  Length of the frame with the trailer.
+ */
+static uint8_t WDC_DLLAppendCrc(uint8_t *frame, uint8_t len)
+{
+#if (WDC_DLL_CRC == 8)
+  frame[len] = WDC_CRC8(WDC_CRC8_INIT, frame, len);
+#elif (WDC_DLL_CRC == 16)
+  uint16_t crc = WDC_CRC16(WDC_CRC16_INIT, frame, len);
+
+  frame[len] = (uint8_t)(crc >> 8);
+  frame[len + 1] = (uint8_t)crc;
+#else
+  (void)frame;
+#endif
+
+  return len + WDC_DLL_CRC_LEN;
+}
+
+/**
+ * @brief   Check the CRC trailer (if enabled) of a received frame.
+ * @param   len: Length of the frame including the trailer.
+ * @retval  True if the frame is intact.
+ */
+static bool WDC_DLLCheckCrc(const uint8_t *frame, uint8_t len)
+{
+  if (len <= WDC_DLL_CRC_LEN)
+  {
+    return false;
+  }
+
+  //
+  // Running the CRC over the frame and its trailer leaves 0.
+  //
+#if (WDC_DLL_CRC == 8)
+  return (WDC_CRC8(WDC_CRC8_INIT, frame, len) == 0);
+#elif (WDC_DLL_CRC == 16)
+  return (WDC_CRC16(WDC_CRC16_INIT, frame, len) == 0);
+#else
+  (void)frame;
+  return true;
+#endif
+}
+
+/**
+ * @brief   Stage the next packet with the PHY.
+ * @note    The PHY holds one packet at a time and sends it at the start
+ *          of the next bus frame. This picks the oldest packet in the
+ *          highest-priority non-empty lane.
  * @retval  None.
  */
-static void WDC_DLLStartOfFrameHandler(void)
+static void WDC_DLLStagePacket(void)
 {
+  dll_tx_lane_t *lane;
+  uint8_t baud;
+  uint8_t idx;
+  uint8_t i;
+
+  //
+  // Retire the packet staged earlier once the PHY has sent all of it.
+  // Until then its slot must stay untouched.
+  //
+  if (dll_tx_inflight != NULL)
+  {
+    if (WDC_PLLIsTransmitting())
+    {
+      return;
+    }
+
+    dll_tx_inflight->tail++;
+    dll_tx_inflight = NULL;
+  }
+
   // 
   // See if we have any packets in queue to send.
   // 
-  
+  for (i = 0; i < WDC_DLL_LANE_COUNT; i++)
+  {
+    lane = &dll_tx_lanes[i];
+
+    if (lane->head != lane->tail)
+    {
+      idx = lane->tail & lane->mask;
+
+      //
+      // The reply to an accepted baud rate switch carries the switch
+      // with it; the PHY switches at the end of the frame that sends it.
+      //
+      baud = WDC_PLL_BAUD_NONE;
+      if ((dll_baud_pending != WDC_DLL_BAUD_NONE) &&
+          (i == WDC_DLL_LANE_ENUMERATION) &&
+          ((uint8_t)(lane->tail + 1) == dll_baud_after))
+      {
+        baud = dll_baud_pending;
+      }
+
+      if (WDC_PLLWritePacket(&lane->slots[idx * lane->slot_size],
+                             lane->lens[idx], baud))
+      {
+        WDC_STAT_INC(dll_stats.tx_packets);
+        dll_tx_inflight = lane;
+
+        if (baud != WDC_PLL_BAUD_NONE)
+        {
+          dll_baud_pending = WDC_DLL_BAUD_NONE;
+        }
+      }
+      break;
+    }
+  }
+}
+
+/**
+ * @brief   Handler for WDC frames.
+ * @note    Runs from WDC_DLLTask() once per bus frame.
+ * @retval  None.
+ */
+static void WDC_DLLStartOfFrameHandler(void)
+{
+  dll_frame_count++;
+  WDC_DLLStagePacket();
 }
 
 /**
@@ -147,32 +561,137 @@ static void WDC_DLLStartOfFrameHandler(void)
  */
 static void WDC_DLLEndOfFrameHandler(void)
 {
+  dll_receive_callback_t handler;
+  uint8_t *frame;
+  uint8_t len;
   uint8_t header;
 
   //
-  // Read the Data-Link Layer Header byte to determine
-  // the type of packet and how to handle it.
+  // Handle every frame waiting in the PHY's receive queue. The
+  // Data-Link Layer Header byte picks the handler from the dispatch
+  // table, which also rejects headers no base sends. Frames are read in
+  // place.
   //
-  if (WDC_PLLCanRead())
+  while ((len = WDC_PLLGetFrame(&frame, NULL)) > 0)
   {
-    header = WDC_PLLPeek();
+    header = frame[WDC_DLL_HEADER_IDX];
+    handler = dll_handlers[pgm_read_byte(&dll_dispatch_slot[header])];
 
     //
-    // Make sure packet is a base-to-companion packet.
+    // Make sure packet is intact and one a base sends.
     //
-    if (header & bmWDC_DLL_HEADER_DIRN == bmWDC_DLL_HEADER_DIRN_B2C)
+    if (!WDC_DLLCheckCrc(frame, len))
+    {
+      WDC_STAT_INC(dll_stats.rx_crc_errors);
+    }
+    else if (handler == NULL)
     {
-      
+      if (!WDC_DLLHeaderIsB2C(header))
+      {
+        WDC_STAT_INC(dll_stats.rx_wrong_direction);
+      }
+      else
+      {
+        WDC_STAT_INC(dll_stats.rx_invalid);
+      }
     }
     else
     {
-      //
-      // Invalid packet. Discard.
-      //
-      WDC_PLLFlushReadPacket();
+      WDC_STAT_INC(dll_stats.rx_packets);
+      WDC_TRACE_EVENT(WDC_TRACE_DLL_DISPATCH, header);
+
+      handler(WDC_DLLHeaderPacketType(header), WDC_DLLHeaderEndpoint(header),
+              &frame[WDC_DLL_HEADER_IDX + 1], len - 1 - WDC_DLL_CRC_LEN);
     }
+
+    //
+    // Done with the frame. Invalid packets are counted and discarded.
+    //
+    WDC_PLLReleaseFrame();
+  }
+}
+
+/**
+ * @brief   Handler for enumeration commands on the control endpoint.
+ * @note    See wdc_datalink.h for the commands and their replies. Unknown
+ *          commands are ignored.
+ * @param   payload: Packet payload, without the header byte.
+ * @param   len: Payload length.
+ * @retval  None.
+ */
+static void WDC_DLLEnumerationHandler(uint8_t type, uint8_t endpoint,
+                                      const uint8_t *payload, uint8_t len)
+{
+  dll_tx_lane_t *lane = &dll_tx_lanes[WDC_DLL_LANE_ENUMERATION];
+  uint8_t reply[WDC_DLL_ENUMERATION_PACKET_LEN - 1];
+  uint8_t baud;
+
+  (void)type;
+  (void)endpoint;
+
+  if (len < 1)
+  {
+    return;
+  }
+
+  reply[0] = payload[0];
+
+  switch (payload[0])
+  {
+    case WDC_DLL_ENUM_GET_BAUD:
+      reply[1] = WDC_PLL_BAUD_SUPPORTED;
+      reply[2] = WDC_PLLGetBaud();
+      WDC_DLLQueuePacket(lane, WDC_DLL_PACKET_TYPE_ENUMERATION,
+                         WDC_DLL_ENDPOINT_CONTROL, reply, 3);
+      break;
+
+    case WDC_DLL_ENUM_SET_BAUD:
+      baud = (len >= 2) ? payload[1] : WDC_DLL_BAUD_NONE;
+
+      if ((baud < WDC_PLL_BAUD_COUNT) &&
+          (WDC_PLL_BAUD_SUPPORTED & (1 << baud)))
+      {
+        //
+        // Arm the switch before queueing, since the reply may be staged
+        // from within WDC_DLLQueuePacket().
+        //
+        dll_baud_pending = baud;
+        dll_baud_after = lane->head + 1;
+        reply[1] = baud;
+        reply[2] = WDC_DLL_ENUM_OK;
+      }
+      else
+      {
+        reply[1] = WDC_PLLGetBaud();
+        reply[2] = WDC_DLL_ENUM_REJECTED;
+      }
+
+      if (!WDC_DLLQueuePacket(lane, WDC_DLL_PACKET_TYPE_ENUMERATION,
+                              WDC_DLL_ENDPOINT_CONTROL, reply, 3))
+      {
+        // No reply, no switch. The base will ask again.
+        dll_baud_pending = WDC_DLL_BAUD_NONE;
+      }
+      break;
+
+    default:
+      break;
   }
 }
 
+/**
+ * @brief   Handler for packets nothing has registered for. They are
+ *          dropped.
+ * @retval  None.
+ */
+static void WDC_DLLDiscardHandler(uint8_t type, uint8_t endpoint,
+                                  const uint8_t *payload, uint8_t len)
+{
+  (void)type;
+  (void)endpoint;
+  (void)payload;
+  (void)len;
+}
+
 /****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
 
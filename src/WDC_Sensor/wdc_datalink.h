@@ -26,6 +26,7 @@ extern "C" {
 /* Includes ----------------------------------------------------------------- */
 #include <stdint.h>
 #include <stdbool.h>
+#include "wdc_stats.h"
 
 /* Defines ------------------------------------------------------------------ */
 //
@@ -42,40 +43,187 @@ extern "C" {
 //        2 - Data
 //        3 - Event
 //
+// b6:4 - Reserved, 0. Packets with any of these set are rejected.
+//
 // b7   - Direction:
 //        1 for Base -> Companion, 0 for Companion -> Base
 //
+// Use the WDC_DLLHeader* functions below rather than the masks directly.
+//
 #define WDC_DLL_HEADER_IDX                        0
-#define bmWDC_DLL_HEADER_ENDPOINT                 (3 << 0)
-#define bmWDC_DLL_HEADER_PACKET_TYPE              (3 << 2)
-#define bmWDC_DLL_HEADER_PACKET_TYPE_ENUMERATION  (0 << 2)
-#define bmWDC_DLL_HEADER_PACKET_TYPE_REQUEST      (1 << 2)
-#define bmWDC_DLL_HEADER_PACKET_TYPE_DATA         (2 << 2)
-#define bmWDC_DLL_HEADER_PACKET_TYPE_EVENT        (3 << 2)
-#define bmWDC_DLL_HEADER_DIRN                     (1 << 7)
-#define bmWDC_DLL_HEADER_DIRN_B2C                 (1 << 7)
-#define bmWDC_DLL_HEADER_DIRN_C2B                 (0 << 7)
+#define WDC_DLL_HEADER_ENDPOINT_POS               0
+#define WDC_DLL_HEADER_PACKET_TYPE_POS            2
+#define WDC_DLL_HEADER_DIRN_POS                   7
+#define bmWDC_DLL_HEADER_ENDPOINT                 (3 << WDC_DLL_HEADER_ENDPOINT_POS)
+#define bmWDC_DLL_HEADER_PACKET_TYPE              (3 << WDC_DLL_HEADER_PACKET_TYPE_POS)
+#define bmWDC_DLL_HEADER_PACKET_TYPE_ENUMERATION  (WDC_DLL_PACKET_TYPE_ENUMERATION << WDC_DLL_HEADER_PACKET_TYPE_POS)
+#define bmWDC_DLL_HEADER_PACKET_TYPE_REQUEST      (WDC_DLL_PACKET_TYPE_REQUEST << WDC_DLL_HEADER_PACKET_TYPE_POS)
+#define bmWDC_DLL_HEADER_PACKET_TYPE_DATA         (WDC_DLL_PACKET_TYPE_DATA << WDC_DLL_HEADER_PACKET_TYPE_POS)
+#define bmWDC_DLL_HEADER_PACKET_TYPE_EVENT        (WDC_DLL_PACKET_TYPE_EVENT << WDC_DLL_HEADER_PACKET_TYPE_POS)
+#define bmWDC_DLL_HEADER_RESERVED                 (7 << 4)
+#define bmWDC_DLL_HEADER_DIRN                     (1 << WDC_DLL_HEADER_DIRN_POS)
+#define bmWDC_DLL_HEADER_DIRN_B2C                 (WDC_DLL_DIRN_B2C << WDC_DLL_HEADER_DIRN_POS)
+#define bmWDC_DLL_HEADER_DIRN_C2B                 (WDC_DLL_DIRN_C2B << WDC_DLL_HEADER_DIRN_POS)
+
+#define WDC_DLL_ENDPOINT_CONTROL                  0
+#define WDC_DLL_ENDPOINT_INPUT                    1
+#define WDC_DLL_ENDPOINT_OUTPUT                   2
+#define WDC_DLL_ENDPOINT_RESERVED                 3
+
+#define WDC_DLL_PACKET_TYPE_ENUMERATION           0
+#define WDC_DLL_PACKET_TYPE_REQUEST               1
+#define WDC_DLL_PACKET_TYPE_DATA                  2
+#define WDC_DLL_PACKET_TYPE_EVENT                 3
+
+#define WDC_DLL_DIRN_C2B                          0
+#define WDC_DLL_DIRN_B2C                          1
+
+//
+// Enumeration Commands
+// Enumeration packets on the control endpoint are handled by the
+// data-link layer itself and are not passed up. Payload byte 0 is the
+// command; the reply repeats it.
+//
+// WDC_DLL_ENUM_GET_BAUD:
+//   Reply: [cmd, supported baud rate bitmap, current baud rate index].
+//   The base can find a companion after a restart by sending this at each
+//   rate in turn until it gets a reply.
+// WDC_DLL_ENUM_SET_BAUD: [cmd, baud rate index]
+//   Reply: [cmd, baud rate index in effect after the frame, status].
+//   Baud rate indices are the PHY's WDC_PLL_BAUD_xxx. An accepted rate
+//   takes effect at the end of the frame carrying the reply; the base
+//   switches once it has received the reply.
+//
+#define WDC_DLL_ENUM_GET_BAUD                     0x01
+#define WDC_DLL_ENUM_SET_BAUD                     0x02
+
+#define WDC_DLL_ENUM_OK                           0
+#define WDC_DLL_ENUM_REJECTED                     1
+
+//
+// Frame Check Definitions
+// Set WDC_DLL_CRC to 8 or 16 to append a CRC-8 or CRC-16 trailer
+// (see wdc_crc.h) to every frame, or to 0 for none. The base must
+// use the same setting.
+//
+#ifndef WDC_DLL_CRC
+#define WDC_DLL_CRC                               0
+#endif
+#define WDC_DLL_CRC_LEN                           (WDC_DLL_CRC / 8)
 
 //
 // Data Packet Definitions
+// Packet lengths include the header but not the CRC trailer. The
+// largest frame on the wire is WDC_DLL_MAX_FRAME_SIZE.
 //
 #define WDC_DLL_MAX_FRAME_SIZE                    50
 #define WDC_DLL_ENUMERATION_PACKET_LEN            4
 #define WDC_DLL_REQUEST_PACKET_LEN                4
-#define WDC_DLL_DATA_PACKET_LEN                   (WDC_DLL_MAX_FRAME_SIZE)
-#define WDC_DLL_EVENT_PACKET_LEN                  (WDC_DLL_MAX_FRAME_SIZE)
+#define WDC_DLL_DATA_PACKET_LEN                   (WDC_DLL_MAX_FRAME_SIZE - WDC_DLL_CRC_LEN)
+#define WDC_DLL_EVENT_PACKET_LEN                  (WDC_DLL_MAX_FRAME_SIZE - WDC_DLL_CRC_LEN)
+
+#if defined(__GNUC__)
+#define WDC_DLL_PACKED                            __attribute__((packed))
+#else
+#define WDC_DLL_PACKED
+#endif
+
+/* Exported Types ----------------------------------------------------------- */
+//
+// Packet layouts, without the CRC trailer. Sizes and offsets are checked
+// at compile time in wdc_datalink.c, so a received frame can be read
+// through these in place.
+//
+typedef struct WDC_DLL_PACKED
+{
+  uint8_t   header;
+  uint8_t   payload[WDC_DLL_ENUMERATION_PACKET_LEN - 1];
+} dll_enumeration_packet_t;
+
+typedef struct WDC_DLL_PACKED
+{
+  uint8_t   header;
+  uint8_t   payload[WDC_DLL_REQUEST_PACKET_LEN - 1];
+} dll_request_packet_t;
+
+typedef struct WDC_DLL_PACKED
+{
+  uint8_t   header;
+  uint8_t   payload[WDC_DLL_DATA_PACKET_LEN - 1];
+} dll_data_packet_t;
+
+typedef struct WDC_DLL_PACKED
+{
+  uint8_t   header;
+  uint8_t   payload[WDC_DLL_EVENT_PACKET_LEN - 1];
+} dll_event_packet_t;
+
+typedef struct
+{
+  wdc_stat_t  rx_packets;         // Intact base-to-companion packets.
+  wdc_stat_t  rx_crc_errors;      // Packets with a bad CRC trailer.
+  wdc_stat_t  rx_wrong_direction; // Companion-to-base packets received.
+  wdc_stat_t  rx_invalid;         // Reserved endpoint or header bits.
+  wdc_stat_t  tx_packets;         // Packets handed to the PHY.
+  wdc_stat_t  tx_lane_full;       // Packets refused, transmit lane full.
+} dll_stats_t;
+
+// Called for each intact base-to-companion packet of the type and
+// endpoint it is registered for. payload excludes the header byte and the
+// CRC trailer.
+typedef void (*dll_receive_callback_t)(uint8_t type, uint8_t endpoint,
+                                       const uint8_t *payload, uint8_t len);
+
+/* Inline Functions --------------------------------------------------------- */
+//
+// Header encode/decode. Each is a single mask and/or shift.
+//
+static inline uint8_t WDC_DLLHeaderEncode(uint8_t dirn, uint8_t type,
+                                          uint8_t endpoint)
+{
+  return (uint8_t)((dirn << WDC_DLL_HEADER_DIRN_POS) |
+                   ((type << WDC_DLL_HEADER_PACKET_TYPE_POS) &
+                    bmWDC_DLL_HEADER_PACKET_TYPE) |
+                   (endpoint & bmWDC_DLL_HEADER_ENDPOINT));
+}
+
+static inline uint8_t WDC_DLLHeaderEndpoint(uint8_t header)
+{
+  return header & bmWDC_DLL_HEADER_ENDPOINT;
+}
+
+static inline uint8_t WDC_DLLHeaderPacketType(uint8_t header)
+{
+  return (uint8_t)((header & bmWDC_DLL_HEADER_PACKET_TYPE) >>
+                   WDC_DLL_HEADER_PACKET_TYPE_POS);
+}
+
+static inline uint8_t WDC_DLLHeaderDirection(uint8_t header)
+{
+  return (uint8_t)(header >> WDC_DLL_HEADER_DIRN_POS);
+}
+
+static inline bool WDC_DLLHeaderIsB2C(uint8_t header)
+{
+  return (header & bmWDC_DLL_HEADER_DIRN) == bmWDC_DLL_HEADER_DIRN_B2C;
+}
 
 /* Function Prototypes ------------------------------------------------------ */
 void WDC_DLLInit(void);
 void WDC_DLLDeinit(void);
-bool WDC_DLLDataTransmitEnumerationPacket(uint8_t *payload);
-bool WDC_DLLDataTransmitRequestPacket(uint8_t *payload);
-bool WDC_DLLDataTransmitDataPacket(uint8_t *payload);
-bool WDC_DLLDataTransmitEventPacket(uint8_t *payload);
-bool WDC_DLLDataReceiveEnumerationPacket(uint8_t *payload);
-bool WDC_DLLDataReceiveRequestPacket(uint8_t *payload);
-bool WDC_DLLDataReceiveDataPacket(uint8_t *payload);
-bool WDC_DLLDataReceiveEventPacket(uint8_t *payload);
+void WDC_DLLTask(void);
+bool WDC_DLLDataTransmitEnumerationPacket(uint8_t endpoint, const uint8_t *payload,
+                                          uint8_t len);
+bool WDC_DLLDataTransmitRequestPacket(uint8_t endpoint, const uint8_t *payload,
+                                      uint8_t len);
+bool WDC_DLLDataTransmitDataPacket(uint8_t endpoint, const uint8_t *payload,
+                                   uint8_t len);
+bool WDC_DLLDataTransmitEventPacket(uint8_t endpoint, const uint8_t *payload,
+                                    uint8_t len);
+uint8_t WDC_DLLFrameCount(void);
+bool WDC_DLLRegisterHandler(uint8_t type, uint8_t endpoint,
+                            dll_receive_callback_t cb);
+void WDC_DLLReadStats(dll_stats_t *stats, bool clear);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,163 @@
+/**
+  ******************************************************************************
+  * @file    wdc_gpio.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) direct port access for the bus
+  *          control pins (WDC_EN, SS, MISO).
+  *
+  *          WDC_GPIO<pin> resolves an Arduino pin number to its PINx, PORTx
+  *          and DDRx registers and bit at compile time, so sampling or
+  *          driving the pin is a single sbic/sbi/cbi instead of the table
+  *          lookups in digitalRead(), digitalWrite() and pinMode().
+  *
+  *          Pins missing from the map below fall back to those calls, so
+  *          every pin still works, only slower. WDC_GPIO<pin>::fast says
+  *          which one a pin got.
+  *
+  *          C++ only. The pin must be a compile-time constant.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDC_GPIO_H__
+#define __WDC_GPIO_H__
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include "Arduino.h"
+
+/* Exported Types ----------------------------------------------------------- */
+//
+// Fallback for pins without a map entry.
+//
+template <uint8_t PIN>
+struct WDC_GPIO
+{
+  static const bool fast = false;
+
+  static inline bool isHigh(void)
+  {
+    return (digitalRead(PIN) == HIGH);
+  }
+
+  // Output, low. The output latch is cleared before the pin turns around
+  // so it never drives high.
+  static inline void driveLow(void)
+  {
+    digitalWrite(PIN, LOW);
+    pinMode(PIN, OUTPUT);
+  }
+
+  // Input with pull-up.
+  static inline void release(void)
+  {
+    pinMode(PIN, INPUT_PULLUP);
+  }
+
+  // Direction only, for pins whose level a peripheral drives.
+  static inline void output(void)
+  {
+    pinMode(PIN, OUTPUT);
+  }
+
+  static inline void input(void)
+  {
+    pinMode(PIN, INPUT);
+  }
+};
+
+/* Defines ------------------------------------------------------------------ */
+//
+// Map entry: Arduino pin number, port letter and bit. Every port used
+// here is in the low I/O space, so each access is one instruction and
+// safe against interrupts.
+//
+#define WDC_GPIO_PIN(pin, port, bit)                          \
+  template <>                                                 \
+  struct WDC_GPIO<pin>                                        \
+  {                                                           \
+    static const bool fast = true;                            \
+    static inline bool isHigh(void)                           \
+    {                                                         \
+      return (PIN##port & _BV(bit)) != 0;                     \
+    }                                                         \
+    static inline void driveLow(void)                         \
+    {                                                         \
+      PORT##port &= (uint8_t)~_BV(bit);                       \
+      DDR##port |= _BV(bit);                                  \
+    }                                                         \
+    static inline void release(void)                          \
+    {                                                         \
+      DDR##port &= (uint8_t)~_BV(bit);                        \
+      PORT##port |= _BV(bit);                                 \
+    }                                                         \
+    static inline void output(void)                           \
+    {                                                         \
+      DDR##port |= _BV(bit);                                  \
+    }                                                         \
+    static inline void input(void)                            \
+    {                                                         \
+      DDR##port &= (uint8_t)~_BV(bit);                        \
+    }                                                         \
+  }
+
+//
+// Pin Maps
+// Uno, Nano, Pro Mini and other ATmega8/168/328 boards: every pin.
+// Mega: the external interrupt pins, SS and MISO.
+// Leonardo, Micro: the external interrupt pins, SS and MISO.
+//
+#if defined(__AVR_ATmega8__) || defined(__AVR_ATmega88__) || \
+    defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || \
+    defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
+WDC_GPIO_PIN(0, D, 0);
+WDC_GPIO_PIN(1, D, 1);
+WDC_GPIO_PIN(2, D, 2);
+WDC_GPIO_PIN(3, D, 3);
+WDC_GPIO_PIN(4, D, 4);
+WDC_GPIO_PIN(5, D, 5);
+WDC_GPIO_PIN(6, D, 6);
+WDC_GPIO_PIN(7, D, 7);
+WDC_GPIO_PIN(8, B, 0);
+WDC_GPIO_PIN(9, B, 1);
+WDC_GPIO_PIN(10, B, 2);
+WDC_GPIO_PIN(11, B, 3);
+WDC_GPIO_PIN(12, B, 4);
+WDC_GPIO_PIN(13, B, 5);
+WDC_GPIO_PIN(14, C, 0);
+WDC_GPIO_PIN(15, C, 1);
+WDC_GPIO_PIN(16, C, 2);
+WDC_GPIO_PIN(17, C, 3);
+WDC_GPIO_PIN(18, C, 4);
+WDC_GPIO_PIN(19, C, 5);
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+WDC_GPIO_PIN(2, E, 4);
+WDC_GPIO_PIN(3, E, 5);
+WDC_GPIO_PIN(18, D, 3);
+WDC_GPIO_PIN(19, D, 2);
+WDC_GPIO_PIN(20, D, 1);
+WDC_GPIO_PIN(21, D, 0);
+WDC_GPIO_PIN(50, B, 3);
+WDC_GPIO_PIN(53, B, 0);
+#elif defined(__AVR_ATmega32U4__)
+WDC_GPIO_PIN(0, D, 2);
+WDC_GPIO_PIN(1, D, 3);
+WDC_GPIO_PIN(2, D, 1);
+WDC_GPIO_PIN(3, D, 0);
+WDC_GPIO_PIN(7, E, 6);
+WDC_GPIO_PIN(14, B, 3);
+WDC_GPIO_PIN(17, B, 0);
+#endif
+
+#endif /* __WDC_GPIO_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
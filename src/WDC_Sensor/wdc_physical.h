@@ -0,0 +1,118 @@
+/**
+  ******************************************************************************
+  * @file    wdc_physical.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) physical-link layer (PHY)
+  *          interface and selection.
+  *
+  *          Every PHY implements the same WDC_PLLxxx() functions, so the
+  *          layers above include this header and call them directly. The
+  *          PHY is picked at build time with WDC_PHY; only the selected
+  *          one is compiled, and there is no function table or other
+  *          indirection between the data-link layer and the PHY.
+  *
+  *          A PHY header provides:
+  *            WDC_PLL_MAX_FRAME_SIZE   Largest frame it can receive.
+  *            WDC_PLL_BAUD_COUNT       Number of baud rate indices.
+  *            WDC_PLL_BAUD_DEFAULT     Index the bus starts at.
+  *            WDC_PLL_BAUD_SUPPORTED   Bitmap of usable indices.
+  *          and these functions:
+  *            WDC_PLLInit(), WDC_PLLDeinit(), WDC_PLLTask(),
+  *            WDC_IsBusActive(), WDC_PLLWritePacket(),
+  *            WDC_PLLIsTransmitting(), WDC_PLLCanRead(), WDC_PLLPeek(),
+  *            WDC_PLLReadPacket(), WDC_PLLFlushReadPacket(),
+  *            WDC_PLLGetFrame(), WDC_PLLReleaseFrame(),
+  *            WDC_PLLReadStats(), WDC_PLLGetBaud(),
+  *            WDC_PLLRegisterStartOfFrameCallback(),
+  *            WDC_PLLRegisterEndOfFrameCallback().
+  *          They may be static inline in the header.
+  *
+  *          WDC_PLLWritePacket(packet, len, baud) stages a packet together
+  *          with the baud rate index to switch to at the end of the frame
+  *          that sends it, or WDC_PLL_BAUD_NONE. Both are handed over in
+  *          one step, so the switch cannot miss the frame carrying the
+  *          packet that announces it.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDC_PHYSICAL_H__
+#define __WDC_PHYSICAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include "wdc_stats.h"
+
+/* Defines ------------------------------------------------------------------ */
+//
+// PHY Selection
+// WDC_PHY_UART     - Hardware UART plus the WDC_EN line (wdcuart_physical).
+// WDC_PHY_SPI      - SPI slave, framed by SS (wdcspi_physical).
+// WDC_PHY_LOOP     - In-process loopback for host builds (wdcloop_physical).
+//                    Also selected by defining WDC_PHY_LOOPBACK.
+//
+#define WDC_PHY_UART              1
+#define WDC_PHY_SPI               2
+#define WDC_PHY_LOOP              3
+
+// No baud rate switch (see WDC_PLLWritePacket()).
+#define WDC_PLL_BAUD_NONE         0xFF
+
+#ifndef WDC_PHY
+#if defined(WDC_PHY_LOOPBACK)
+#define WDC_PHY                   WDC_PHY_LOOP
+#else
+#define WDC_PHY                   WDC_PHY_UART
+#endif
+#endif
+
+/* Exported Types ----------------------------------------------------------- */
+typedef void (*eof_callback_t)(void);
+typedef void (*sof_callback_t)(void);
+
+//
+// Counters every PHY keeps. A PHY that cannot see an event leaves its
+// counter at 0.
+//
+typedef struct
+{
+  wdc_stat_t  rx_overruns;        // Bytes dropped, receive buffer full.
+  wdc_stat_t  rx_parity_errors;   // Bytes dropped with a parity error.
+  wdc_stat_t  tx_waits;           // Transmit bytes that had to wait.
+  wdc_stat_t  rx_frames;          // Frames queued for the data-link layer.
+  wdc_stat_t  rx_frames_dropped;  // Frames lost, receive queue full.
+  wdc_stat_t  rx_empty_frames;    // Frames that carried no bytes.
+  wdc_stat_t  rx_flushes;         // Times unframed bytes were discarded.
+} pll_stats_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+/* Selected PHY ------------------------------------------------------------- */
+#if (WDC_PHY == WDC_PHY_UART)
+#include "wdcuart_physical.h"
+#elif (WDC_PHY == WDC_PHY_SPI)
+#include "wdcspi_physical.h"
+#elif (WDC_PHY == WDC_PHY_LOOP)
+#include "wdcloop_physical.h"
+#else
+#error "Unknown WDC_PHY."
+#endif
+
+#endif /* __WDC_PHYSICAL_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
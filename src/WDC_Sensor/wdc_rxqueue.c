@@ -0,0 +1,190 @@
+/**
+  ******************************************************************************
+  * @file    wdc_rxqueue.c
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    10-Sep-2014
+  * @brief   Wearable Device Companion (WDC) physical-link receive queue.
+  *
+  *          The producer (BeginFrame/EndFrame) runs in the PHY's interrupt
+  *          context and the consumer (Peek/Pop) in the upper layers. The
+  *          descriptor indices are free-running 8-bit counters, so each side
+  *          only ever writes its own index and both read atomically.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include <stddef.h>
+#include "wdc_rxqueue.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define WDC_RXQ_MASK              (WDC_RXQ_DEPTH - 1)
+
+#if ((WDC_RXQ_DEPTH & WDC_RXQ_MASK) != 0) || (WDC_RXQ_DEPTH > 128)
+#error "WDC_RXQ_DEPTH must be a power of two no larger than 128."
+#endif
+
+#if (WDC_RXQ_BUFFER_SIZE <= WDC_RXQ_MAX_FRAME_SIZE)
+#error "WDC_RXQ_BUFFER_SIZE must hold more than one frame."
+#endif
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ * @brief   Initialize an empty receive queue.
+ * @retval  None.
+ */
+void WDC_RXQInit(wdc_rxqueue_t *q)
+{
+  q->head = 0;
+  q->tail = 0;
+  q->write_offset = 0;
+  q->frame_offset = 0;
+}
+
+/**
+ * @brief   Reserve room for the next frame.
+ * @note    The reserved area is WDC_RXQ_MAX_FRAME_SIZE contiguous bytes and
+ *          never overlaps a frame that has not been popped yet.
+ * @retval  Where to store the frame. NULL if the queue is full, in which case
+ *          the frame must be dropped.
+ */
+uint8_t *WDC_RXQBeginFrame(wdc_rxqueue_t *q)
+{
+  uint8_t count = (uint8_t)(q->head - q->tail);
+  uint16_t start = q->write_offset;
+  uint16_t oldest;
+
+  if (count >= WDC_RXQ_DEPTH)
+  {
+    return NULL;
+  }
+
+  if (count == 0)
+  {
+    //
+    // Nothing is queued, so the whole ring is free.
+    //
+    start = 0;
+  }
+  else
+  {
+    oldest = q->desc[q->tail & WDC_RXQ_MASK].offset;
+
+    if (start >= oldest)
+    {
+      //
+      // Free space runs from the newest frame to the end of the ring,
+      // then from the start of the ring to the oldest frame. A frame
+      // is never split, so wrap if it would not fit at the end. The
+      // comparisons are strict so the newest frame never ends exactly
+      // on the oldest one, which would look like an empty ring.
+      //
+      if ((start + WDC_RXQ_MAX_FRAME_SIZE) > WDC_RXQ_BUFFER_SIZE)
+      {
+        if (oldest <= WDC_RXQ_MAX_FRAME_SIZE)
+        {
+          return NULL;
+        }
+        start = 0;
+      }
+    }
+    else if ((start + WDC_RXQ_MAX_FRAME_SIZE) >= oldest)
+    {
+      return NULL;
+    }
+  }
+
+  q->frame_offset = start;
+  return &q->buffer[start];
+}
+
+/**
+ * @brief   Commit the frame reserved by WDC_RXQBeginFrame().
+ * @param   len: Number of bytes received. 0 abandons the reservation.
+ * @param   timestamp: When the frame was received.
+ * @retval  None.
+ */
+void WDC_RXQEndFrame(wdc_rxqueue_t *q, uint8_t len, uint32_t timestamp)
+{
+  volatile wdc_frame_desc_t *desc = &q->desc[q->head & WDC_RXQ_MASK];
+
+  if (len == 0)
+  {
+    return;
+  }
+
+  desc->offset = q->frame_offset;
+  desc->len = len;
+  desc->timestamp = timestamp;
+  q->write_offset = q->frame_offset + len;
+
+  //
+  // Publish the frame last.
+  //
+  q->head++;
+}
+
+/**
+ * @brief   Number of complete frames waiting in the queue.
+ * @retval  Frame count.
+ */
+uint8_t WDC_RXQCount(const wdc_rxqueue_t *q)
+{
+  return (uint8_t)(q->head - q->tail);
+}
+
+/**
+ * @brief   Get the oldest queued frame in place.
+ * @param   frame: Set to point at the first byte of the frame.
+ * @param   timestamp: Set to the time the frame was received. May be NULL.
+ * @retval  Length of the frame. 0 if the queue is empty.
+ */
+uint8_t WDC_RXQPeek(wdc_rxqueue_t *q, uint8_t **frame, uint32_t *timestamp)
+{
+  volatile wdc_frame_desc_t *desc = &q->desc[q->tail & WDC_RXQ_MASK];
+
+  if (q->head == q->tail)
+  {
+    return 0;
+  }
+
+  *frame = &q->buffer[desc->offset];
+  if (timestamp != NULL)
+  {
+    *timestamp = desc->timestamp;
+  }
+
+  return desc->len;
+}
+
+/**
+ * @brief   Remove the oldest queued frame.
+ * @retval  None.
+ */
+void WDC_RXQPop(wdc_rxqueue_t *q)
+{
+  if (q->head != q->tail)
+  {
+    q->tail++;
+  }
+}
+
+/**
+ * @brief   Remove every queued frame.
+ * @retval  None.
+ */
+void WDC_RXQFlush(wdc_rxqueue_t *q)
+{
+  q->tail = q->head;
+}
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file    wdc_rxqueue.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    10-Sep-2014
+  * @brief   Wearable Device Companion (WDC) physical-link receive queue.
+  *
+  *          Received frames are stored back to back in a byte ring. A small
+  *          queue of descriptors (offset, length, timestamp) records where
+  *          each complete frame starts, so several frames can wait for the
+  *          upper layers. Every frame is kept contiguous so it can be read
+  *          in place.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDC_RXQUEUE_H__
+#define __WDC_RXQUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Largest frame that can be received.
+#ifndef WDC_RXQ_MAX_FRAME_SIZE
+#define WDC_RXQ_MAX_FRAME_SIZE    50
+#endif
+
+// Size of the byte ring shared by all queued frames.
+#ifndef WDC_RXQ_BUFFER_SIZE
+#define WDC_RXQ_BUFFER_SIZE       (4 * WDC_RXQ_MAX_FRAME_SIZE)
+#endif
+
+// Maximum number of queued frames. Must be a power of two.
+#ifndef WDC_RXQ_DEPTH
+#define WDC_RXQ_DEPTH             8
+#endif
+
+/* Exported Types ----------------------------------------------------------- */
+typedef struct
+{
+  uint16_t  offset;
+  uint8_t   len;
+  uint32_t  timestamp;
+} wdc_frame_desc_t;
+
+typedef struct
+{
+  uint8_t                     buffer[WDC_RXQ_BUFFER_SIZE];
+  volatile wdc_frame_desc_t   desc[WDC_RXQ_DEPTH];
+  volatile uint8_t            head;
+  volatile uint8_t            tail;
+  uint16_t                    write_offset;
+  uint16_t                    frame_offset;
+} wdc_rxqueue_t;
+
+/* Function Prototypes ------------------------------------------------------ */
+void      WDC_RXQInit(wdc_rxqueue_t *q);
+uint8_t  *WDC_RXQBeginFrame(wdc_rxqueue_t *q);
+void      WDC_RXQEndFrame(wdc_rxqueue_t *q, uint8_t len, uint32_t timestamp);
+uint8_t   WDC_RXQCount(const wdc_rxqueue_t *q);
+uint8_t   WDC_RXQPeek(wdc_rxqueue_t *q, uint8_t **frame, uint32_t *timestamp);
+void      WDC_RXQPop(wdc_rxqueue_t *q);
+void      WDC_RXQFlush(wdc_rxqueue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WDC_RXQUEUE_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,52 @@
+/**
+  ******************************************************************************
+  * @file    wdc_stats.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) statistics counters.
+  *
+  *          Each layer counts the events it would otherwise drop silently
+  *          (overruns, bad packets, retransmissions, ...). Counters stick
+  *          at their maximum instead of wrapping, so a large reading never
+  *          turns into a small one. The base reads them over the control
+  *          endpoint (see wdc_comm.h).
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDC_STATS_H__
+#define __WDC_STATS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------ */
+#define WDC_STAT_MAX                0xFFFF
+
+//
+// Saturating increment. Cheap enough for interrupt context.
+//
+#define WDC_STAT_INC(counter) \
+  do { if ((counter) != WDC_STAT_MAX) { (counter)++; } } while (0)
+
+/* Exported Types ----------------------------------------------------------- */
+typedef uint16_t wdc_stat_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WDC_STATS_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
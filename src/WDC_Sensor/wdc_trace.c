@@ -0,0 +1,154 @@
+/**
+  ******************************************************************************
+  * @file    wdc_trace.c
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) hot-path latency trace.
+  *
+  *          Events are recorded from interrupt handlers and the main loop
+  *          alike, so each record masks interrupts for the few instructions
+  *          it takes to claim a slot.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include "wdc_trace.h"
+
+// Nothing to build unless tracing is enabled.
+#if WDC_TRACE
+
+#include <stddef.h>
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#endif
+
+/* Defines ------------------------------------------------------------------ */
+#define WDC_TRACE_MASK            (WDC_TRACE_DEPTH - 1)
+
+#if ((WDC_TRACE_DEPTH & WDC_TRACE_MASK) != 0) || (WDC_TRACE_DEPTH > 128)
+#error "WDC_TRACE_DEPTH must be a power of two no larger than 128."
+#endif
+
+#if defined(__AVR__)
+#define WDC_TRACE_NOW()           TCNT1
+#define WDC_TRACE_LOCK()          uint8_t oldSREG = SREG; cli()
+#define WDC_TRACE_UNLOCK()        SREG = oldSREG
+#else
+#define WDC_TRACE_NOW()           (trace_clock ? trace_clock() : 0)
+#define WDC_TRACE_LOCK()
+#define WDC_TRACE_UNLOCK()
+#endif
+
+/* Private Variables -------------------------------------------------------- */
+//
+// Free-running 8-bit indices. head - tail is the number of events held;
+// recording into a full ring drops the oldest.
+//
+static wdc_trace_entry_t trace_ring[WDC_TRACE_DEPTH];
+static volatile uint8_t trace_head = 0;
+static volatile uint8_t trace_tail = 0;
+#if !defined(__AVR__)
+static wdc_trace_clock_t trace_clock = NULL;
+#endif
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ * @brief   Empty the ring and start the timestamp timer.
+ * @retval  None.
+ */
+void WDC_TraceInit(void)
+{
+  trace_head = 0;
+  trace_tail = 0;
+
+#if defined(__AVR__)
+  //
+  // Timer1: normal mode, clk/8, no interrupts.
+  //
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11);
+  TIMSK1 = 0;
+#endif
+}
+
+/**
+ * @brief   Record an event. Use WDC_TRACE_EVENT() instead so the call
+ *          compiles out when tracing is disabled.
+ * @param   event: WDC_TRACE_xxx.
+ * @param   arg: Event argument (see wdc_trace.h).
+ * @retval  None.
+ */
+void WDC_TraceRecord(uint8_t event, uint8_t arg)
+{
+  wdc_trace_entry_t *entry;
+  WDC_TRACE_LOCK();
+
+  entry = &trace_ring[trace_head & WDC_TRACE_MASK];
+  entry->ticks = (uint16_t)WDC_TRACE_NOW();
+  entry->event = event;
+  entry->arg = arg;
+
+  trace_head++;
+  if ((uint8_t)(trace_head - trace_tail) > WDC_TRACE_DEPTH)
+  {
+    trace_tail++;
+  }
+
+  WDC_TRACE_UNLOCK();
+}
+
+/**
+ * @brief   Take the oldest events out of the ring.
+ * @param   entries: Destination for up to max events.
+ * @retval  Number of events copied.
+ */
+uint8_t WDC_TraceRead(wdc_trace_entry_t *entries, uint8_t max)
+{
+  uint8_t count = 0;
+
+  while (count < max)
+  {
+    WDC_TRACE_LOCK();
+
+    if (trace_tail == trace_head)
+    {
+      WDC_TRACE_UNLOCK();
+      break;
+    }
+    entries[count++] = trace_ring[trace_tail & WDC_TRACE_MASK];
+    trace_tail++;
+
+    WDC_TRACE_UNLOCK();
+  }
+
+  return count;
+}
+
+/**
+ * @brief   Set the timestamp clock for host builds.
+ * @note    Ignored on AVR, which always uses Timer1.
+ * @retval  None.
+ */
+void WDC_TraceSetClock(wdc_trace_clock_t clock)
+{
+#if defined(__AVR__)
+  (void)clock;
+#else
+  trace_clock = clock;
+#endif
+}
+
+#endif /* WDC_TRACE */
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,102 @@
+/**
+  ******************************************************************************
+  * @file    wdc_trace.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) hot-path latency trace.
+  *
+  *          Records timestamped events (frame edges, first received byte,
+  *          packet dispatch, transmit start and end) into a small ring so
+  *          bus turnaround and processing latency can be measured on real
+  *          hardware. The base reads the ring over the control endpoint
+  *          (see wdc_comm.h); host tools call WDC_TraceRead() directly.
+  *
+  *          Disabled by default. With WDC_TRACE set to 0 every
+  *          WDC_TRACE_EVENT() compiles to nothing and the ring takes no
+  *          RAM.
+  *
+  *          On AVR the timestamps are Timer1 ticks. Tracing takes Timer1
+  *          over (free running, clk/8), so PWM on its pins and libraries
+  *          that use it (e.g. Servo) do not work while it is enabled.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDC_TRACE_H__
+#define __WDC_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defines ------------------------------------------------------------------ */
+// Set to 1 to build the trace in.
+#ifndef WDC_TRACE
+#define WDC_TRACE                 0
+#endif
+
+// Events kept in the ring. Must be a power of two no larger than 128. The
+// oldest event is overwritten when the ring is full.
+#ifndef WDC_TRACE_DEPTH
+#define WDC_TRACE_DEPTH           32
+#endif
+
+// Timestamp ticks per millisecond.
+#ifndef WDC_TRACE_TICKS_PER_MS
+#if defined(__AVR__)
+#define WDC_TRACE_TICKS_PER_MS    (F_CPU / 8000UL)
+#else
+#define WDC_TRACE_TICKS_PER_MS    1000UL
+#endif
+#endif
+
+//
+// Trace Events. The argument recorded with each is noted.
+//
+#define WDC_TRACE_SOF             1   // WDC_EN falling edge. 0.
+#define WDC_TRACE_EOF             2   // WDC_EN rising edge. Frame length.
+#define WDC_TRACE_RX_FIRST_BYTE   3   // First byte of a frame received. 0.
+#define WDC_TRACE_DLL_DISPATCH    4   // Packet handed up. DLL header byte.
+#define WDC_TRACE_TX_START        5   // Staged packet released. 0.
+#define WDC_TRACE_TX_COMPLETE     6   // Packet fully sent. 0.
+
+#if WDC_TRACE
+#define WDC_TRACE_EVENT(event, arg) WDC_TraceRecord((event), (uint8_t)(arg))
+#else
+#define WDC_TRACE_EVENT(event, arg) ((void)0)
+#endif
+
+/* Exported Types ----------------------------------------------------------- */
+typedef struct
+{
+  uint16_t  ticks;
+  uint8_t   event;
+  uint8_t   arg;
+} wdc_trace_entry_t;
+
+typedef uint32_t (*wdc_trace_clock_t)(void);
+
+/* Function Prototypes ------------------------------------------------------ */
+void    WDC_TraceInit(void);
+void    WDC_TraceRecord(uint8_t event, uint8_t arg);
+uint8_t WDC_TraceRead(wdc_trace_entry_t *entries, uint8_t max);
+void    WDC_TraceSetClock(wdc_trace_clock_t clock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WDC_TRACE_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -18,32 +18,650 @@
 
 
 /* Includes ----------------------------------------------------------------- */
+#include <stddef.h>
+#include <string.h>
 #include "wdc_transport.h"
 #include "wdc_datalink.h"
 
 /* Defines ------------------------------------------------------------------ */
+// Segments needed for the largest message.
+#define WDC_TLL_MAX_SEGMENTS      ((WDC_TLL_MAX_MESSAGE_SIZE + WDC_TLL_SEGMENT_PAYLOAD - 1) / \
+                                   WDC_TLL_SEGMENT_PAYLOAD)
+
+#define WDC_TLL_WINDOW_MASK       (WDC_TLL_WINDOW_SIZE - 1)
+
+#if (WDC_TLL_MAX_SEGMENTS > 32)
+#error "WDC_TLL_MAX_MESSAGE_SIZE needs more than 32 segments."
+#endif
+
+#if ((WDC_TLL_WINDOW_SIZE & WDC_TLL_WINDOW_MASK) != 0) || (WDC_TLL_WINDOW_SIZE > 8)
+#error "WDC_TLL_WINDOW_SIZE must be a power of two no larger than 8."
+#endif
+
+#if (WDC_TLL_RETRANSMIT_FRAMES >= 128)
+#error "WDC_TLL_RETRANSMIT_FRAMES must be less than 128."
+#endif
+
+/* Private Types ------------------------------------------------------------ */
+typedef struct
+{
+  bool      in_use;
+  uint8_t   endpoint;
+  uint8_t   first_seq;
+  uint8_t   last_index;
+  uint8_t   last_len;
+  uint32_t  received;
+  uint8_t   buffer[WDC_TLL_MAX_MESSAGE_SIZE];
+} tll_reassembly_t;
+
+typedef struct
+{
+  uint8_t   endpoint;
+  uint8_t   flags;
+  uint8_t   len;
+  uint8_t   sent_frame;
+  uint8_t   data[WDC_TLL_SEGMENT_PAYLOAD];
+} tll_tx_segment_t;
 
 /* Private Variables -------------------------------------------------------- */
+//
+// Receive side. Updated from the data-link receive callback, which runs
+// from WDC_TLLTask(). rx_next is the next sequence number expected and
+// rx_sack the segments received beyond it. Messages are delivered in
+// order, from rx_deliver.
+//
+static tll_reassembly_t tll_rx_pool[WDC_TLL_REASSEMBLY_POOL_SIZE];
+static tll_receive_callback_t tll_receive_callback = NULL;
+static uint8_t tll_rx_next = 0;
+static uint8_t tll_rx_sack = 0;
+static uint8_t tll_rx_deliver = 0;
+static bool tll_ack_pending = false;
+
+//
+// Latest acknowledgement from the peer. peer_count changes with every
+// one received.
+//
+static uint8_t tll_peer_ack = 0;
+static uint8_t tll_peer_sack = 0;
+static uint8_t tll_peer_count = 0;
+static uint8_t tll_peer_count_seen = 0;
+
+//
+// Message being segmented. It is copied in so the caller's buffer is
+// free as soon as WDC_TLLSendMessage() returns.
+//
+static uint8_t tll_tx_buffer[WDC_TLL_MAX_MESSAGE_SIZE];
+static uint16_t tll_tx_len = 0;
+static uint16_t tll_tx_offset = 0;
+static uint8_t tll_tx_endpoint = 0;
+static uint8_t tll_tx_index = 0;
+static bool tll_tx_pending = false;
+
+//
+// Segments in flight, indexed by sequence number. Sequence numbers run on
+// across messages so the next message can start while the last one is
+// still being acknowledged.
+//
+static tll_tx_segment_t tll_tx_window[WDC_TLL_WINDOW_SIZE];
+static uint8_t tll_tx_una = 0;          // Oldest unacknowledged segment.
+static uint8_t tll_tx_next = 0;         // Next sequence number to use.
+static uint8_t tll_tx_acked = 0;        // Window slots acknowledged.
+static uint8_t tll_tx_due = 0;          // Window slots to send now.
+static uint8_t tll_tx_sent = 0;         // Window slots sent at least once.
+static uint8_t tll_tx_frame = 0;        // Bus frame of the last packet queued.
+
+static tll_stats_t tll_stats;
 
 /* Private Function Prototypes ---------------------------------------------- */
+static void WDC_TLLReceiveHandler(uint8_t type, uint8_t endpoint,
+                                  const uint8_t *payload, uint8_t len);
+static bool WDC_TLLReassemble(uint8_t endpoint, uint8_t flags, uint8_t seq,
+                              const uint8_t *data, uint8_t len, bool in_order);
+static tll_reassembly_t *WDC_TLLFindReassembly(uint8_t first_seq);
+static void WDC_TLLDeliver(void);
+static void WDC_TLLProcessAck(void);
+static void WDC_TLLFillWindow(void);
+static bool WDC_TLLSendSegment(uint8_t seq);
 
 /* Function Definitions ----------------------------------------------------- */
 /**
- * @brief   
+ * @brief   Initialize the transport-link layer (and the layers below it).
  * @retval  None.
  */
 void WDC_TLLInit(void)
 {
+  uint8_t i;
 
+  for (i = 0; i < WDC_TLL_REASSEMBLY_POOL_SIZE; i++)
+  {
+    tll_rx_pool[i].in_use = false;
+  }
+  tll_rx_next = 0;
+  tll_rx_sack = 0;
+  tll_rx_deliver = 0;
+  tll_ack_pending = false;
+  tll_peer_count_seen = tll_peer_count;
+  tll_tx_pending = false;
+  tll_tx_una = 0;
+  tll_tx_next = 0;
+  tll_tx_acked = 0;
+  tll_tx_due = 0;
+  tll_tx_sent = 0;
+
+  WDC_DLLInit();
+  WDC_DLLRegisterHandler(WDC_DLL_PACKET_TYPE_DATA, WDC_DLL_ENDPOINT_CONTROL,
+                         WDC_TLLReceiveHandler);
+  WDC_DLLRegisterHandler(WDC_DLL_PACKET_TYPE_DATA, WDC_DLL_ENDPOINT_INPUT,
+                         WDC_TLLReceiveHandler);
+  WDC_DLLRegisterHandler(WDC_DLL_PACKET_TYPE_DATA, WDC_DLL_ENDPOINT_OUTPUT,
+                         WDC_TLLReceiveHandler);
+  tll_tx_frame = (uint8_t)(WDC_DLLFrameCount() - 1);
 }
 
 /**
- * @brief   
+ * @brief   De-initialize the transport-link layer (and the layers below it).
+ * @note    A message still being sent and any partly reassembled ones are
+ *          dropped.
  * @retval  None.
  */
 void WDC_TLLDeinit(void)
 {
+  uint8_t i;
+
+  WDC_DLLDeinit();
+
+  for (i = 0; i < WDC_TLL_REASSEMBLY_POOL_SIZE; i++)
+  {
+    tll_rx_pool[i].in_use = false;
+  }
+  tll_receive_callback = NULL;
+  tll_rx_next = 0;
+  tll_rx_sack = 0;
+  tll_rx_deliver = 0;
+  tll_ack_pending = false;
+  tll_tx_pending = false;
+  tll_tx_len = 0;
+  tll_tx_offset = 0;
+  tll_tx_una = 0;
+  tll_tx_next = 0;
+  tll_tx_acked = 0;
+  tll_tx_due = 0;
+  tll_tx_sent = 0;
+}
+
+/**
+ * @brief   Start sending a message.
+ * @note    Segments are queued on the data lane as the window allows. Call
+ *          WDC_TLLTask() regularly until WDC_TLLIsSending() returns false.
+ * @param   endpoint: Endpoint the message belongs to.
+ * @param   len: Message length, 1 to WDC_TLL_MAX_MESSAGE_SIZE.
+ * @retval  True if the message was accepted. False if its length is out of
+ *          range or the previous message has not been fully segmented.
+ */
+bool WDC_TLLSendMessage(uint8_t endpoint, const uint8_t *message, uint16_t len)
+{
+  if (tll_tx_pending || (len == 0) || (len > WDC_TLL_MAX_MESSAGE_SIZE))
+  {
+    return false;
+  }
+
+  memcpy(tll_tx_buffer, message, len);
+  tll_tx_len = len;
+  tll_tx_offset = 0;
+  tll_tx_endpoint = endpoint;
+  tll_tx_index = 0;
+  tll_tx_pending = true;
+
+  WDC_TLLTask();
+
+  return true;
+}
+
+/**
+ * @brief   Whether WDC_TLLSendMessage() would accept a message now.
+ * @retval  True once the previous message has been fully segmented.
+ */
+bool WDC_TLLCanSend(void)
+{
+  return !tll_tx_pending;
+}
+
+/**
+ * @brief   Whether anything sent is still waiting to be acknowledged.
+ * @retval  True until every segment has been acknowledged.
+ */
+bool WDC_TLLIsSending(void)
+{
+  return tll_tx_pending || (tll_tx_una != tll_tx_next);
+}
+
+/**
+ * @brief   Run the data-link layer, process acknowledgements, move new
+ *          segments into the window, then send the segments that are due.
+ * @note    Call from the main loop, not from interrupt context.
+ * @retval  None.
+ */
+void WDC_TLLTask(void)
+{
+  tll_tx_segment_t *segment;
+  uint8_t now;
+  uint8_t seq;
+  uint8_t slot;
+
+  //
+  // Received frames are delivered from here, so acknowledgements are
+  // current before anything is sent.
+  //
+  WDC_DLLTask();
+  now = WDC_DLLFrameCount();
+
+  WDC_TLLProcessAck();
+  WDC_TLLFillWindow();
+
+  //
+  // The bus carries one packet per frame, so queue at most one per frame.
+  // Keeping the data lane short means retransmissions go out promptly
+  // and each packet carries a fresh acknowledgement.
+  //
+  if (now == tll_tx_frame)
+  {
+    return;
+  }
+
+  //
+  // Send new segments, those reported missing and those not acknowledged
+  // in time. Acknowledged segments are left alone.
+  //
+  for (seq = tll_tx_una; seq != tll_tx_next; seq++)
+  {
+    slot = seq & WDC_TLL_WINDOW_MASK;
+    segment = &tll_tx_window[slot];
+    if ((tll_tx_acked & (1 << slot)) ||
+        (!(tll_tx_due & (1 << slot)) &&
+         ((uint8_t)(now - segment->sent_frame) < WDC_TLL_RETRANSMIT_FRAMES)))
+    {
+      continue;
+    }
+
+    if (WDC_TLLSendSegment(seq))
+    {
+      WDC_STAT_INC(tll_stats.tx_segments);
+      if (tll_tx_sent & (1 << slot))
+      {
+        WDC_STAT_INC(tll_stats.tx_retransmits);
+      }
+      tll_tx_sent |= 1 << slot;
+      segment->sent_frame = now;
+      tll_tx_due &= ~(1 << slot);
+      tll_tx_frame = now;
+    }
+    return;
+  }
+
+  //
+  // Nothing to carry the acknowledgement, so send it on its own.
+  //
+  if (tll_ack_pending && WDC_TLLSendSegment(tll_tx_next))
+  {
+    tll_tx_frame = now;
+  }
+}
+
+/**
+ * @brief   Register the callback for reassembled messages.
+ * @retval  None.
+ */
+void WDC_TLLRegisterReceiveCallback(tll_receive_callback_t cb)
+{
+  tll_receive_callback = cb;
+}
+
+/**
+ * @brief   Read the transport-link statistics.
+ * @param   clear: Reset the counters after reading them.
+ * @retval  None.
+ */
+void WDC_TLLReadStats(tll_stats_t *stats, bool clear)
+{
+  *stats = tll_stats;
+  if (clear)
+  {
+    memset(&tll_stats, 0, sizeof(tll_stats));
+  }
+}
+
+/* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   Cut segments from the current message into free window slots.
+ * @retval  None.
+ */
+static void WDC_TLLFillWindow(void)
+{
+  tll_tx_segment_t *segment;
+  uint16_t chunk;
+  uint8_t slot;
+
+  while (tll_tx_pending &&
+         ((uint8_t)(tll_tx_next - tll_tx_una) < WDC_TLL_WINDOW_SIZE))
+  {
+    slot = tll_tx_next & WDC_TLL_WINDOW_MASK;
+    segment = &tll_tx_window[slot];
+
+    chunk = tll_tx_len - tll_tx_offset;
+    if (chunk > WDC_TLL_SEGMENT_PAYLOAD)
+    {
+      chunk = WDC_TLL_SEGMENT_PAYLOAD;
+    }
+
+    segment->endpoint = tll_tx_endpoint;
+    segment->flags = tll_tx_index & bmWDC_TLL_HEADER_INDEX;
+    if (tll_tx_index == 0)
+    {
+      segment->flags |= bmWDC_TLL_HEADER_FIRST;
+    }
+    if ((tll_tx_offset + chunk) == tll_tx_len)
+    {
+      segment->flags |= bmWDC_TLL_HEADER_LAST;
+      tll_tx_pending = false;
+    }
+    segment->len = (uint8_t)chunk;
+    memcpy(segment->data, &tll_tx_buffer[tll_tx_offset], chunk);
+
+    tll_tx_offset += chunk;
+    tll_tx_index++;
+    tll_tx_due |= 1 << slot;
+    tll_tx_sent &= ~(1 << slot);
+    tll_tx_next++;
+  }
+}
+
+/**
+ * @brief   Queue one segment on the data lane with the current
+ *          acknowledgement.
+ * @param   seq: Sequence number of the segment. tll_tx_next sends the
+ *          acknowledgement only.
+ * @retval  True if the data lane took the packet.
+ */
+static bool WDC_TLLSendSegment(uint8_t seq)
+{
+  uint8_t packet[WDC_TLL_HEADER_LEN + WDC_TLL_SEGMENT_PAYLOAD];
+  tll_tx_segment_t *segment = &tll_tx_window[seq & WDC_TLL_WINDOW_MASK];
+  uint8_t endpoint = WDC_DLL_ENDPOINT_CONTROL;
+  uint8_t len = 0;
+
+  packet[WDC_TLL_HEADER_FLAGS_IDX] = 0;
+  if (seq != tll_tx_next)
+  {
+    endpoint = segment->endpoint;
+    len = segment->len;
+    packet[WDC_TLL_HEADER_FLAGS_IDX] = segment->flags;
+    memcpy(&packet[WDC_TLL_HEADER_LEN], segment->data, len);
+  }
+  packet[WDC_TLL_HEADER_SEQ_IDX] = seq;
+  packet[WDC_TLL_HEADER_ACK_IDX] = tll_rx_next;
+  packet[WDC_TLL_HEADER_SACK_IDX] = tll_rx_sack;
+  tll_ack_pending = false;
+
+  if (!WDC_DLLDataTransmitDataPacket(endpoint, packet,
+                                     (uint8_t)(WDC_TLL_HEADER_LEN + len)))
+  {
+    tll_ack_pending = true;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Apply the latest acknowledgement from the peer to the segments
+ *          in flight.
+ * @note    A segment the peer skipped over is marked to be sent again at
+ *          once if it was sent no later than a segment the peer has.
+ * @retval  None.
+ */
+static void WDC_TLLProcessAck(void)
+{
+  uint8_t inflight = (uint8_t)(tll_tx_next - tll_tx_una);
+  uint8_t ack = tll_peer_ack;
+  uint8_t sack = tll_peer_sack;
+  uint8_t seq;
+  uint8_t slot;
+  uint8_t newest = tll_tx_una;
+  uint8_t newest_frame = 0;
+  uint8_t i;
+
+  if (tll_peer_count == tll_peer_count_seen)
+  {
+    return;
+  }
+  tll_peer_count_seen = tll_peer_count;
+
+  //
+  // Everything before ack has arrived.
+  //
+  if ((uint8_t)(ack - tll_tx_una) <= inflight)
+  {
+    for (seq = tll_tx_una; seq != ack; seq++)
+    {
+      tll_tx_acked |= 1 << (seq & WDC_TLL_WINDOW_MASK);
+    }
+  }
+
+  //
+  // Then the selectively acknowledged segments beyond it.
+  //
+  for (i = 0; i < 8; i++)
+  {
+    seq = (uint8_t)(ack + 1 + i);
+    if ((sack & (1 << i)) && ((uint8_t)(seq - tll_tx_una) < inflight))
+    {
+      slot = seq & WDC_TLL_WINDOW_MASK;
+      tll_tx_acked |= 1 << slot;
+      newest = seq + 1;
+      newest_frame = tll_tx_window[slot].sent_frame;
+    }
+  }
+
+  //
+  // Holes below the newest segment received were lost if they went out
+  // no later than it did.
+  //
+  for (seq = tll_tx_una; seq != newest; seq++)
+  {
+    slot = seq & WDC_TLL_WINDOW_MASK;
+    if (!(tll_tx_acked & (1 << slot)) &&
+        ((int8_t)(tll_tx_window[slot].sent_frame - newest_frame) <= 0))
+    {
+      tll_tx_due |= 1 << slot;
+    }
+  }
+
+  //
+  // Slide the window past the acknowledged segments.
+  //
+  while ((tll_tx_una != tll_tx_next) &&
+         (tll_tx_acked & (1 << (tll_tx_una & WDC_TLL_WINDOW_MASK))))
+  {
+    slot = tll_tx_una & WDC_TLL_WINDOW_MASK;
+    tll_tx_acked &= ~(1 << slot);
+    tll_tx_due &= ~(1 << slot);
+    tll_tx_una++;
+  }
+}
+
+/**
+ * @brief   Find the reassembly buffer of the message starting at first_seq.
+ * @retval  The buffer, or NULL if there is none.
+ */
+static tll_reassembly_t *WDC_TLLFindReassembly(uint8_t first_seq)
+{
+  uint8_t i;
+
+  for (i = 0; i < WDC_TLL_REASSEMBLY_POOL_SIZE; i++)
+  {
+    if (tll_rx_pool[i].in_use && (tll_rx_pool[i].first_seq == first_seq))
+    {
+      return &tll_rx_pool[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief   Store a segment in its message's reassembly buffer.
+ * @note    Segments may arrive in any order. One buffer is always kept
+ *          back for the segment the receive window is waiting on, so
+ *          later messages cannot take the whole pool and stall it.
+ * @param   in_order: The segment is the next one expected.
+ * @retval  False if there is no room for the segment.
+ */
+static bool WDC_TLLReassemble(uint8_t endpoint, uint8_t flags, uint8_t seq,
+                              const uint8_t *data, uint8_t len, bool in_order)
+{
+  uint8_t index = flags & bmWDC_TLL_HEADER_INDEX;
+  uint8_t first_seq = (uint8_t)(seq - index);
+  uint16_t offset = (uint16_t)index * WDC_TLL_SEGMENT_PAYLOAD;
+  tll_reassembly_t *rx = WDC_TLLFindReassembly(first_seq);
+  tll_reassembly_t *free_rx = NULL;
+  uint8_t free_count = 0;
+  uint8_t i;
+
+  if ((index >= WDC_TLL_MAX_SEGMENTS) ||
+      ((offset + len) > WDC_TLL_MAX_MESSAGE_SIZE))
+  {
+    return false;
+  }
+
+  if (rx == NULL)
+  {
+    for (i = 0; i < WDC_TLL_REASSEMBLY_POOL_SIZE; i++)
+    {
+      if (!tll_rx_pool[i].in_use)
+      {
+        free_rx = &tll_rx_pool[i];
+        free_count++;
+      }
+    }
+    if ((free_count == 0) || (!in_order && (free_count < 2)))
+    {
+      return false;
+    }
+
+    rx = free_rx;
+    rx->in_use = true;
+    rx->endpoint = endpoint;
+    rx->first_seq = first_seq;
+    rx->last_index = 0xFF;
+    rx->received = 0;
+  }
+
+  memcpy(&rx->buffer[offset], data, len);
+  rx->received |= (uint32_t)1 << index;
+  if (flags & bmWDC_TLL_HEADER_LAST)
+  {
+    rx->last_index = index;
+    rx->last_len = len;
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Hand complete messages to the application, oldest first.
+ * @retval  None.
+ */
+static void WDC_TLLDeliver(void)
+{
+  tll_reassembly_t *rx;
+
+  while (((rx = WDC_TLLFindReassembly(tll_rx_deliver)) != NULL) &&
+         (rx->last_index != 0xFF) &&
+         (rx->received == (((uint32_t)2 << rx->last_index) - 1)))
+  {
+    if (tll_receive_callback != NULL)
+    {
+      tll_receive_callback(rx->endpoint, rx->buffer,
+                           (uint16_t)rx->last_index * WDC_TLL_SEGMENT_PAYLOAD +
+                           rx->last_len);
+    }
+    WDC_STAT_INC(tll_stats.rx_messages);
+    tll_rx_deliver += rx->last_index + 1;
+    rx->in_use = false;
+  }
+}
+
+/**
+ * @brief   Handler for packets received by the data-link layer.
+ * @retval  None.
+ */
+static void WDC_TLLReceiveHandler(uint8_t type, uint8_t endpoint,
+                                  const uint8_t *payload, uint8_t len)
+{
+  uint8_t seq;
+  uint8_t offset;
+
+  (void)type;
+
+  if (len < WDC_TLL_HEADER_LEN)
+  {
+    return;
+  }
+
+  //
+  // Every packet carries the peer's acknowledgement.
+  //
+  tll_peer_ack = payload[WDC_TLL_HEADER_ACK_IDX];
+  tll_peer_sack = payload[WDC_TLL_HEADER_SACK_IDX];
+  tll_peer_count++;
+
+  if (len == WDC_TLL_HEADER_LEN)
+  {
+    return;
+  }
+
+  //
+  // Whatever happens to the segment, tell the peer where we are. A
+  // duplicate means our acknowledgement was lost.
+  //
+  tll_ack_pending = true;
+
+  seq = payload[WDC_TLL_HEADER_SEQ_IDX];
+  offset = (uint8_t)(seq - tll_rx_next);
+  if ((offset >= WDC_TLL_WINDOW_SIZE) ||
+      ((offset > 0) && (tll_rx_sack & (1 << (offset - 1)))))
+  {
+    WDC_STAT_INC(tll_stats.rx_duplicates);
+    return;
+  }
+
+  if (!WDC_TLLReassemble(endpoint, payload[WDC_TLL_HEADER_FLAGS_IDX], seq,
+                         &payload[WDC_TLL_HEADER_LEN],
+                         len - WDC_TLL_HEADER_LEN, (offset == 0)))
+  {
+    //
+    // Not acknowledged, so the peer will send it again.
+    //
+    WDC_STAT_INC(tll_stats.rx_dropped);
+    return;
+  }
+  WDC_STAT_INC(tll_stats.rx_segments);
 
+  if (offset == 0)
+  {
+    tll_rx_next++;
+    while (tll_rx_sack & 1)
+    {
+      tll_rx_sack >>= 1;
+      tll_rx_next++;
+    }
+    tll_rx_sack >>= 1;
+    WDC_TLLDeliver();
+  }
+  else
+  {
+    tll_rx_sack |= 1 << (offset - 1);
+  }
 }
 
 /****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
@@ -6,6 +6,11 @@
   * @date    03-Sep-2014
   * @brief   Wearable Device Companion (WDC) transport-link layer for the WDC
   *          communication protocol.
+  *
+  *          Messages larger than one data packet are split into segments,
+  *          sent as consecutive data packets and reassembled on receipt.
+  *          Segments are numbered and acknowledged with a sliding window;
+  *          only the segments the peer reports missing are sent again.
   *  
   ******************************************************************************
   * @attention
@@ -16,8 +21,8 @@
   ******************************************************************************
   */
 
-#ifndef __WDCUART_DATALINK_H__
-#define __WDCUART_DATALINK_H__
+#ifndef __WDC_TRANSPORT_H__
+#define __WDC_TRANSPORT_H__
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,17 +31,91 @@ extern "C" {
 /* Includes ----------------------------------------------------------------- */
 #include <stdint.h>
 #include <stdbool.h>
+#include "wdc_datalink.h"
 
 /* Defines ------------------------------------------------------------------ */
+//
+// WDC Transport-Link Segment Header Definitions
+// Byte 0:
+//   b5:0 - Segment index within the message, starting at 0.
+//   b6   - Last segment of the message.
+//   b7   - First segment of the message.
+// Byte 1:
+//   Segment sequence number. Incremented for every new segment sent.
+// Byte 2:
+//   Acknowledgement: the next sequence number expected from the peer.
+//   Every earlier segment has been received.
+// Byte 3:
+//   Selective acknowledgement: bit n set if segment (ack + 1 + n) has
+//   been received.
+//
+// A packet with no bytes after the header only carries the
+// acknowledgement.
+//
+#define WDC_TLL_HEADER_LEN                4
+#define WDC_TLL_HEADER_FLAGS_IDX          0
+#define WDC_TLL_HEADER_SEQ_IDX            1
+#define WDC_TLL_HEADER_ACK_IDX            2
+#define WDC_TLL_HEADER_SACK_IDX           3
+#define bmWDC_TLL_HEADER_INDEX            0x3F
+#define bmWDC_TLL_HEADER_LAST             (1 << 6)
+#define bmWDC_TLL_HEADER_FIRST            (1 << 7)
+
+// Message bytes carried by one segment. A message no longer than this
+// takes a single bus frame.
+#define WDC_TLL_SEGMENT_PAYLOAD           (WDC_DLL_DATA_PACKET_LEN - 1 - WDC_TLL_HEADER_LEN)
+
+// Largest message that can be sent or reassembled.
+#ifndef WDC_TLL_MAX_MESSAGE_SIZE
+#define WDC_TLL_MAX_MESSAGE_SIZE          256
+#endif
+
+// Number of messages that can be reassembled at once (e.g. one per
+// endpoint).
+#ifndef WDC_TLL_REASSEMBLY_POOL_SIZE
+#define WDC_TLL_REASSEMBLY_POOL_SIZE      2
+#endif
+
+// Segments that may be sent before the oldest one is acknowledged. Must
+// be a power of two no larger than 8. Both ends must agree.
+#ifndef WDC_TLL_WINDOW_SIZE
+#define WDC_TLL_WINDOW_SIZE               4
+#endif
+
+// Bus frames to wait for an acknowledgement before sending a segment
+// again. Must be less than 128.
+#ifndef WDC_TLL_RETRANSMIT_FRAMES
+#define WDC_TLL_RETRANSMIT_FRAMES         8
+#endif
+
+/* Exported Types ----------------------------------------------------------- */
+typedef void (*tll_receive_callback_t)(uint8_t endpoint, const uint8_t *message,
+                                       uint16_t len);
+
+typedef struct
+{
+  wdc_stat_t  tx_segments;        // Segments queued, counting resends.
+  wdc_stat_t  tx_retransmits;     // Segments sent more than once.
+  wdc_stat_t  rx_segments;        // Segments accepted.
+  wdc_stat_t  rx_duplicates;      // Segments already received.
+  wdc_stat_t  rx_dropped;         // Segments with no reassembly room.
+  wdc_stat_t  rx_messages;        // Messages delivered.
+} tll_stats_t;
 
 /* Function Prototypes ------------------------------------------------------ */
 void WDC_TLLInit(void);
 void WDC_TLLDeinit(void);
+void WDC_TLLTask(void);
+bool WDC_TLLSendMessage(uint8_t endpoint, const uint8_t *message, uint16_t len);
+bool WDC_TLLIsSending(void);
+bool WDC_TLLCanSend(void);
+void WDC_TLLRegisterReceiveCallback(tll_receive_callback_t cb);
+void WDC_TLLReadStats(tll_stats_t *stats, bool clear);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif /* __WDCUART_DATALINK_H__ */
+#endif /* __WDC_TRANSPORT_H__ */
 /****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
 
@@ -0,0 +1,564 @@
+/**
+  ******************************************************************************
+  * @file    wdcloop_physical.c
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    08-Sep-2014
+  * @brief   Wearable Device Companion (WDC) physical-link layer (PHY) for the
+  *          WDC communication protocol (in-process loopback).
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include "wdc_physical.h"
+
+// This PHY only exists for host builds. Keep it out of the Arduino build.
+#if (WDC_PHY == WDC_PHY_LOOP)
+
+#include <stddef.h>
+#include <string.h>
+#include "wdc_trace.h"
+
+/* Defines ------------------------------------------------------------------ */
+#define WDC_LOOP_PIPE_MASK      (WDC_LOOP_PIPE_SIZE - 1)
+
+#if ((WDC_LOOP_PIPE_SIZE & WDC_LOOP_PIPE_MASK) != 0)
+#error "WDC_LOOP_PIPE_SIZE must be a power of two."
+#endif
+
+/* Private Types ------------------------------------------------------------ */
+typedef struct
+{
+  uint8_t   buffer[WDC_LOOP_PIPE_SIZE];
+  uint16_t  head;
+  uint16_t  tail;
+} loop_pipe_t;
+
+/* Private Variables -------------------------------------------------------- */
+static loop_pipe_t c2b_pipe;
+static wdc_rxqueue_t rx_queue;
+static uint8_t *rx_frame = NULL;
+static uint8_t rx_frame_count = 0;
+static wdc_loop_clock_t loop_clock = NULL;
+static bool base_en_low = false;
+static bool companion_en_low = false;
+static bool en_line_low = false;
+static volatile bool wdcbus_active = false;
+static const uint8_t *tx_packet = NULL;
+static uint16_t tx_len = 0;
+static uint8_t tx_baud = WDC_PLL_BAUD_NONE;
+static volatile uint8_t sof_count = 0;
+static uint8_t sof_handled = 0;
+static sof_callback_t sof_callback = NULL;
+static eof_callback_t eof_callback = NULL;
+static pll_stats_t pll_stats;
+static uint8_t pll_baud = WDC_PLL_BAUD_DEFAULT;
+static uint8_t pll_baud_next = WDC_PLL_BAUD_NONE;
+
+/* Private Function Prototypes ---------------------------------------------- */
+static uint16_t WDC_LoopPipeAvailable(const loop_pipe_t *pipe);
+static uint16_t WDC_LoopPipePut(loop_pipe_t *pipe, const uint8_t *data,
+                                uint16_t len);
+static uint16_t WDC_LoopPipeGet(loop_pipe_t *pipe, uint8_t *data,
+                                uint16_t len);
+static void WDC_LoopUpdateLine(void);
+static void WDC_PLLEnableBus(void);
+static void WDC_PLLDisableBus(void);
+static void WDC_PLLIntHandler(void);
+static void WDC_PLLTransmitCompleteHandler(void);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ * @brief   Initialize the physical-link layer for the WDC loopback
+ *          communication protocol.
+ * @retval  None.
+ */
+void WDC_PLLInit(void)
+{
+  c2b_pipe.tail = c2b_pipe.head;
+  WDC_RXQInit(&rx_queue);
+  rx_frame = NULL;
+
+  //
+  // Both ends release the line. The pull-up holds it HIGH.
+  //
+  base_en_low = false;
+  companion_en_low = false;
+  en_line_low = false;
+  wdcbus_active = false;
+  tx_packet = NULL;
+  sof_handled = sof_count;
+  pll_baud = WDC_PLL_BAUD_DEFAULT;
+  pll_baud_next = WDC_PLL_BAUD_NONE;
+
+#if WDC_TRACE
+  WDC_TraceInit();
+#endif
+}
+
+/**
+ * @brief   De-initialize the physical-link layer for the WDC loopback
+ *          communication protocol.
+ * @retval  None.
+ */
+void WDC_PLLDeinit(void)
+{
+  sof_callback = NULL;
+  eof_callback = NULL;
+  WDC_PLLInit();
+}
+
+/**
+ * @brief   Check whether the WDC bus is active or not.
+ * @retval  True if the bus is currently active. False otherwise.
+ */
+bool WDC_IsBusActive(void)
+{
+  return wdcbus_active;
+}
+
+/**
+ * @brief   Run the frame callbacks deferred by the WDC_EN "interrupt".
+ * @note    Same rules as the UART PHY: call from the main loop.
+ * @retval  None.
+ */
+void WDC_PLLTask(void)
+{
+  while (sof_handled != sof_count)
+  {
+    sof_handled++;
+
+    if (sof_callback)
+    {
+      sof_callback();
+    }
+  }
+
+  if (eof_callback && (WDC_RXQCount(&rx_queue) > 0))
+  {
+    eof_callback();
+  }
+}
+
+/**
+ * @brief   Stage a packet for the next bus frame.
+ * @note    The loopback "transmits" instantly when the frame starts, so
+ *          the packet is on the wire before WDC_LoopBaseStartFrame()
+ *          returns.
+ * @param   baud: Baud rate index (WDC_PLL_BAUD_xxx) to switch to at the
+ *          end of the frame that sends the packet, or WDC_PLL_BAUD_NONE.
+ *          Same timing as the UART PHY; only the index is recorded.
+ * @retval  True if the packet was staged. False if a previous packet is
+ *          still staged.
+ */
+bool WDC_PLLWritePacket(const uint8_t *packet, uint16_t len, uint8_t baud)
+{
+  if ((len == 0) || (packet == NULL) || (tx_packet != NULL))
+  {
+    return false;
+  }
+
+  tx_packet = packet;
+  tx_len = len;
+  tx_baud = (baud < WDC_PLL_BAUD_COUNT) ? baud : WDC_PLL_BAUD_NONE;
+
+  return true;
+}
+
+/**
+ * @brief   Check whether a packet is still staged.
+ * @retval  True until the next frame has sent the staged packet.
+ */
+bool WDC_PLLIsTransmitting(void)
+{
+  return (tx_packet != NULL);
+}
+
+/**
+ * @brief   Check whether a received frame is waiting to be read.
+ * @retval  True if an unread packet is available. False otherwise.
+ */
+bool WDC_PLLCanRead(void)
+{
+  return (WDC_RXQCount(&rx_queue) > 0);
+}
+
+/**
+ * @brief   Peek at the first byte of the packet.
+ * @retval  First byte of the packet of an unread packet is available.
+ *          -1 otherwise.
+ */
+int WDC_PLLPeek(void)
+{
+  uint8_t *frame;
+
+  return (WDC_RXQPeek(&rx_queue, &frame, NULL) > 0) ? frame[0] : -1;
+}
+
+/**
+ * @brief   Get a received packet (if one exists) from the physical layer.
+ * @param   packet: Destination buffer.
+ * @param   len: Size of the destination buffer.
+ * @retval  Number of bytes copied into the packet buffer.
+ */
+uint16_t WDC_PLLReadPacket(uint8_t *packet, uint16_t len)
+{
+  uint8_t *frame;
+  uint16_t frame_len = WDC_RXQPeek(&rx_queue, &frame, NULL);
+
+  if (len > frame_len)
+  {
+    len = frame_len;
+  }
+
+  memcpy(packet, frame, len);
+  WDC_PLLReleaseFrame();
+
+  return len;
+}
+
+/**
+ * @brief   Discard every received packet.
+ * @retval  None.
+ */
+void  WDC_PLLFlushReadPacket(void)
+{
+  WDC_RXQFlush(&rx_queue);
+}
+
+/**
+ * @brief   Get the oldest received frame in place, without copying it.
+ * @param   frame: Set to point at the first byte of the frame.
+ * @param   timestamp: Set to the time the frame ended. May be NULL.
+ * @retval  Length of the frame. 0 if no frame is waiting.
+ */
+uint16_t WDC_PLLGetFrame(uint8_t **frame, uint32_t *timestamp)
+{
+  return WDC_RXQPeek(&rx_queue, frame, timestamp);
+}
+
+/**
+ * @brief   Hand the frame returned by WDC_PLLGetFrame() back to the PHY.
+ * @retval  None.
+ */
+void WDC_PLLReleaseFrame(void)
+{
+  WDC_RXQPop(&rx_queue);
+}
+
+/**
+ * @brief   Read the physical-link statistics.
+ * @note    The loopback has no UART. Bytes the base writes past the end
+ *          of a frame count as overruns, bytes outside a frame as flushes.
+ * @param   clear: Reset the counters after reading them.
+ * @retval  None.
+ */
+void WDC_PLLReadStats(pll_stats_t *stats, bool clear)
+{
+  *stats = pll_stats;
+  if (clear)
+  {
+    memset(&pll_stats, 0, sizeof(pll_stats));
+  }
+}
+
+/**
+ * @brief   Current bus baud rate.
+ * @retval  Baud rate index (WDC_PLL_BAUD_xxx).
+ */
+uint8_t WDC_PLLGetBaud(void)
+{
+  return pll_baud;
+}
+
+/**
+ * @brief   Register the Start-of-Frame callback.
+ * @retval  None.
+ */
+void WDC_PLLRegisterStartOfFrameCallback(eof_callback_t cb)
+{
+  sof_callback = cb;
+}
+
+/**
+ * @brief   Register the End-of-Frame callback.
+ * @retval  None.
+ */
+void WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb)
+{
+  eof_callback = cb;
+}
+
+/**
+ * @brief   Base pulls WDC_EN low to open a frame.
+ * @retval  None.
+ */
+void WDC_LoopBaseStartFrame(void)
+{
+  base_en_low = true;
+  WDC_LoopUpdateLine();
+}
+
+/**
+ * @brief   Base releases WDC_EN to close a frame.
+ * @note    The frame only ends once the companion has released the line too.
+ * @retval  None.
+ */
+void WDC_LoopBaseEndFrame(void)
+{
+  base_en_low = false;
+  WDC_LoopUpdateLine();
+}
+
+/**
+ * @brief   Put base-to-companion bytes on the wire.
+ * @note    Like the UART PHY, the companion only keeps bytes that arrive
+ *          inside a frame, and only up to WDC_PLL_MAX_FRAME_SIZE of them.
+ *          They land directly in the companion's receive queue.
+ * @retval  Number of bytes the companion kept.
+ */
+uint16_t WDC_LoopBaseWrite(const uint8_t *data, uint16_t len)
+{
+  uint16_t room = WDC_PLL_MAX_FRAME_SIZE - rx_frame_count;
+
+  if (!wdcbus_active || (rx_frame == NULL))
+  {
+    WDC_STAT_INC(pll_stats.rx_flushes);
+    return 0;
+  }
+
+  if (len > room)
+  {
+    WDC_STAT_INC(pll_stats.rx_overruns);
+    len = room;
+  }
+
+  if ((rx_frame_count == 0) && (len > 0))
+  {
+    WDC_TRACE_EVENT(WDC_TRACE_RX_FIRST_BYTE, 0);
+  }
+
+  memcpy(&rx_frame[rx_frame_count], data, len);
+  rx_frame_count += len;
+
+  return len;
+}
+
+/**
+ * @brief   Number of companion-to-base bytes waiting to be read.
+ * @retval  Byte count.
+ */
+uint16_t WDC_LoopBaseAvailable(void)
+{
+  return WDC_LoopPipeAvailable(&c2b_pipe);
+}
+
+/**
+ * @brief   Read companion-to-base bytes off the wire.
+ * @retval  Number of bytes read.
+ */
+uint16_t WDC_LoopBaseRead(uint8_t *data, uint16_t len)
+{
+  return WDC_LoopPipeGet(&c2b_pipe, data, len);
+}
+
+/**
+ * @brief   Set the clock used to timestamp received frames.
+ * @retval  None.
+ */
+void WDC_LoopSetClock(wdc_loop_clock_t clock)
+{
+  loop_clock = clock;
+}
+
+/**
+ * @brief   Sample the simulated WDC_EN line.
+ * @retval  True if either end is holding the line low.
+ */
+bool WDC_LoopIsEnableLow(void)
+{
+  return en_line_low;
+}
+
+/* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   Number of bytes queued in a pipe.
+ * @retval  Byte count.
+ */
+static uint16_t WDC_LoopPipeAvailable(const loop_pipe_t *pipe)
+{
+  return (uint16_t)(pipe->head - pipe->tail) & WDC_LOOP_PIPE_MASK;
+}
+
+/**
+ * @brief   Append bytes to a pipe. Bytes that do not fit are dropped, as an
+ *          overflowing UART receive buffer would.
+ * @retval  Number of bytes stored.
+ */
+static uint16_t WDC_LoopPipePut(loop_pipe_t *pipe, const uint8_t *data,
+                                uint16_t len)
+{
+  uint16_t count = 0;
+
+  while ((count < len) &&
+         (((pipe->head + 1) & WDC_LOOP_PIPE_MASK) != pipe->tail))
+  {
+    pipe->buffer[pipe->head] = data[count++];
+    pipe->head = (pipe->head + 1) & WDC_LOOP_PIPE_MASK;
+  }
+
+  return count;
+}
+
+/**
+ * @brief   Remove bytes from a pipe.
+ * @retval  Number of bytes copied out.
+ */
+static uint16_t WDC_LoopPipeGet(loop_pipe_t *pipe, uint8_t *data, uint16_t len)
+{
+  uint16_t count = 0;
+
+  while ((count < len) && (pipe->head != pipe->tail))
+  {
+    data[count++] = pipe->buffer[pipe->tail];
+    pipe->tail = (pipe->tail + 1) & WDC_LOOP_PIPE_MASK;
+  }
+
+  return count;
+}
+
+/**
+ * @brief   Resolve the open-drain WDC_EN line and raise the pin-change
+ *          "interrupt" if its level changed.
+ * @retval  None.
+ */
+static void WDC_LoopUpdateLine(void)
+{
+  bool low = base_en_low || companion_en_low;
+
+  if (low != en_line_low)
+  {
+    en_line_low = low;
+    WDC_PLLIntHandler();
+  }
+}
+
+/**
+ * @brief   Enable the bus.
+ * @retval  None.
+ */
+static void WDC_PLLEnableBus(void)
+{
+  companion_en_low = true;
+  WDC_LoopUpdateLine();
+}
+
+/**
+ * @brief   Disable the bus.
+ * @retval  None.
+ */
+static void WDC_PLLDisableBus(void)
+{
+  companion_en_low = false;
+  WDC_LoopUpdateLine();
+}
+
+/**
+ * @brief   Simulated WDC_EN pin-change interrupt.
+ * @note    Top half only, as in the UART PHY. The frame callbacks run
+ *          later from WDC_PLLTask().
+ * @retval  None.
+ */
+static void WDC_PLLIntHandler(void)
+{
+  //
+  // Same framing rules as the UART PHY: a frame starts on a falling
+  // edge and ends on a rising edge.
+  //
+  if (en_line_low)
+  {
+    WDC_TRACE_EVENT(WDC_TRACE_SOF, 0);
+    wdcbus_active = true;
+
+    //
+    // Reserve room for the frame in the receive queue.
+    //
+    rx_frame = WDC_RXQBeginFrame(&rx_queue);
+    rx_frame_count = 0;
+    if (rx_frame == NULL)
+    {
+      WDC_STAT_INC(pll_stats.rx_frames_dropped);
+    }
+
+    //
+    // Send the staged packet.
+    //
+    if (tx_packet != NULL)
+    {
+      WDC_TRACE_EVENT(WDC_TRACE_TX_START, 0);
+      WDC_PLLEnableBus();
+      WDC_LoopPipePut(&c2b_pipe, tx_packet, tx_len);
+      tx_packet = NULL;
+      WDC_PLLTransmitCompleteHandler();
+      pll_baud_next = tx_baud;
+    }
+
+    sof_count++;
+  }
+  else
+  {
+    wdcbus_active = false;
+
+    //
+    // Publish the received frame.
+    //
+    if (rx_frame != NULL)
+    {
+      WDC_TRACE_EVENT(WDC_TRACE_EOF, rx_frame_count);
+      WDC_RXQEndFrame(&rx_queue, rx_frame_count,
+                      loop_clock ? loop_clock() : 0);
+      rx_frame = NULL;
+
+      if (rx_frame_count > 0)
+      {
+        WDC_STAT_INC(pll_stats.rx_frames);
+      }
+      else
+      {
+        WDC_STAT_INC(pll_stats.rx_empty_frames);
+      }
+    }
+
+    if (pll_baud_next != WDC_PLL_BAUD_NONE)
+    {
+      pll_baud = pll_baud_next;
+      pll_baud_next = WDC_PLL_BAUD_NONE;
+    }
+  }
+}
+
+/**
+ * @brief
+ * @retval  None.
+ */
+static void WDC_PLLTransmitCompleteHandler(void)
+{
+  //
+  // Release the WDC_EN line.
+  //
+  WDC_TRACE_EVENT(WDC_TRACE_TX_COMPLETE, 0);
+  WDC_PLLDisableBus();
+}
+
+#endif /* WDC_PHY == WDC_PHY_LOOP */
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    wdcloop_physical.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    08-Sep-2014
+  * @brief   Wearable Device Companion (WDC) physical-link layer (PHY) for the
+  *          WDC communication protocol (in-process loopback).
+  *
+  *          This PHY replaces the UART and the WDC_EN line with two byte
+  *          pipes and a simulated open-drain enable line so the upper layers
+  *          can be run and benchmarked on a host. It is only compiled when
+  *          WDC_PHY is WDC_PHY_LOOP (see wdc_physical.h).
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDCLOOP_PHYSICAL_H__
+#define __WDCLOOP_PHYSICAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include "wdc_rxqueue.h"
+#include "wdc_physical.h"
+
+/* Defines ------------------------------------------------------------------ */
+// Largest frame the PHY will receive. Bytes beyond this are dropped.
+#define WDC_PLL_MAX_FRAME_SIZE  WDC_RXQ_MAX_FRAME_SIZE
+
+// Bus baud rates. Same indices as the UART PHY. The loopback has no baud
+// rate, so it accepts every one and only records the switch.
+#define WDC_PLL_BAUD_250K       0
+#define WDC_PLL_BAUD_500K       1
+#define WDC_PLL_BAUD_1M         2
+#define WDC_PLL_BAUD_2M         3
+#define WDC_PLL_BAUD_COUNT      4
+
+#ifndef WDC_PLL_BAUD_DEFAULT
+#define WDC_PLL_BAUD_DEFAULT    WDC_PLL_BAUD_500K
+#endif
+
+#define WDC_PLL_BAUD_SUPPORTED  ((1 << WDC_PLL_BAUD_COUNT) - 1)
+
+// Size of the companion-to-base side of the simulated wire. Must be a power
+// of two.
+#ifndef WDC_LOOP_PIPE_SIZE
+#define WDC_LOOP_PIPE_SIZE      256
+#endif
+
+/* Exported Types ----------------------------------------------------------- */
+typedef uint32_t (*wdc_loop_clock_t)(void);
+
+/* Function Prototypes ------------------------------------------------------ */
+void  WDC_PLLInit(void);
+void  WDC_PLLDeinit(void);
+bool  WDC_IsBusActive(void);
+void  WDC_PLLTask(void);
+bool  WDC_PLLWritePacket(const uint8_t *packet, uint16_t len, uint8_t baud);
+bool  WDC_PLLIsTransmitting(void);
+bool  WDC_PLLCanRead(void);
+int   WDC_PLLPeek(void);
+uint16_t WDC_PLLReadPacket(uint8_t *packet, uint16_t len);
+void  WDC_PLLFlushReadPacket(void);
+uint16_t WDC_PLLGetFrame(uint8_t **frame, uint32_t *timestamp);
+void  WDC_PLLReleaseFrame(void);
+void  WDC_PLLReadStats(pll_stats_t *stats, bool clear);
+uint8_t WDC_PLLGetBaud(void);
+
+void  WDC_PLLRegisterStartOfFrameCallback(eof_callback_t cb);
+void  WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb);
+
+//
+// Base-side controls of the simulated bus.
+//
+void      WDC_LoopBaseStartFrame(void);
+void      WDC_LoopBaseEndFrame(void);
+uint16_t  WDC_LoopBaseWrite(const uint8_t *data, uint16_t len);
+uint16_t  WDC_LoopBaseAvailable(void);
+uint16_t  WDC_LoopBaseRead(uint8_t *data, uint16_t len);
+void      WDC_LoopSetClock(wdc_loop_clock_t clock);
+bool      WDC_LoopIsEnableLow(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WDCLOOP_PHYSICAL_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,522 @@
+/**
+  ******************************************************************************
+  * @file    wdcspi_physical.cpp
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) physical-link layer (PHY) for the
+  *          WDC communication protocol (SPI slave).
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+
+/* Includes ----------------------------------------------------------------- */
+#include "Arduino.h"
+#include "wdc_physical.h"
+
+// Only built when this is the selected PHY (see wdc_physical.h).
+#if (WDC_PHY == WDC_PHY_SPI)
+
+#include <string.h>
+#include "wdcspi_physical.h"
+#include "wdc_gpio.h"
+#include "wdc_trace.h"
+
+/* Defines ------------------------------------------------------------------ */
+// Sent after the companion's packet, or as the whole frame when it has
+// nothing to send.
+#define WDC_SPI_FILL            0x00
+
+#if (WDC_PLL_MAX_FRAME_SIZE > 255)
+#error "The SPI length byte cannot describe a frame this large."
+#endif
+
+#ifndef NULL
+#define NULL  ((void *)0)
+#endif
+
+// Transmit states. A staged packet's length byte waits in SPDR for the
+// next frame and the packet goes out during that frame. A packet written
+// during a frame is pending until SPDR is free at the end of it.
+#define WDC_PLL_TX_IDLE         0
+#define WDC_PLL_TX_PENDING      1
+#define WDC_PLL_TX_STAGED       2
+#define WDC_PLL_TX_SENDING      3
+
+/* Private Variables -------------------------------------------------------- */
+static volatile bool wdcbus_active = false;
+static wdc_rxqueue_t rx_queue;
+static uint8_t *rx_frame = NULL;
+static volatile uint8_t rx_len = 0;
+static volatile uint8_t rx_count = 0;
+static const uint8_t * volatile tx_packet = NULL;
+static volatile uint8_t tx_len = 0;
+static volatile uint8_t tx_count = 0;
+static volatile uint8_t tx_state = WDC_PLL_TX_IDLE;
+static volatile uint8_t sof_count = 0;
+static uint8_t sof_handled = 0;
+static sof_callback_t sof_callback = NULL;
+static eof_callback_t eof_callback = NULL;
+static pll_stats_t pll_stats;
+
+/* Private Function Prototypes ---------------------------------------------- */
+static void WDC_PLLStartOfFrame(void);
+static void WDC_PLLEndOfFrame(void);
+
+/* Function Definitions ----------------------------------------------------- */
+/**
+ * @brief   Initialize the physical-link layer for the WDC SPI communication
+ *          protocol.
+ * @retval  None.
+ */
+void WDC_PLLInit(void)
+{
+  WDC_RXQInit(&rx_queue);
+  rx_frame = NULL;
+  tx_packet = NULL;
+  tx_state = WDC_PLL_TX_IDLE;
+  sof_handled = sof_count;
+
+#if WDC_TRACE
+  WDC_TraceInit();
+#endif
+
+  //
+  // SPI slave: MISO is the only output. Its direction is not tied to SS
+  // in hardware, so the frame handlers turn it on while SS is low and
+  // off again after, leaving the line free for other slaves.
+  //
+  pinMode(SS, INPUT_PULLUP);
+  pinMode(MOSI, INPUT);
+  pinMode(SCK, INPUT);
+  pinMode(MISO, INPUT);
+  SPCR = _BV(SPE) | _BV(SPIE) | ((WDC_SPI_MODE & 0x03) << CPHA);
+  SPDR = 0;
+
+  //
+  // SS frames the bus. Interrupt on both edges with its pin-change
+  // interrupt.
+  //
+  *digitalPinToPCMSK(SS) |= _BV(digitalPinToPCMSKbit(SS));
+  *digitalPinToPCICR(SS) |= _BV(digitalPinToPCICRbit(SS));
+}
+
+/**
+ * @brief   De-initialize the physical-link layer for the WDC SPI communication
+ *          protocol.
+ * @retval  None.
+ */
+void WDC_PLLDeinit(void)
+{
+  uint8_t oldSREG = SREG;
+
+  //
+  // Stop the SPI and the SS interrupt. PCICR stays as it is, since other
+  // pins in the group may still use it.
+  //
+  cli();
+  *digitalPinToPCMSK(SS) &= (uint8_t)~_BV(digitalPinToPCMSKbit(SS));
+  SPCR = 0;
+  SREG = oldSREG;
+
+  pinMode(MISO, INPUT);
+
+  wdcbus_active = false;
+  rx_frame = NULL;
+  tx_packet = NULL;
+  tx_state = WDC_PLL_TX_IDLE;
+  sof_handled = sof_count;
+  sof_callback = NULL;
+  eof_callback = NULL;
+}
+
+/**
+ * @brief   Check whether the WDC bus is active or not.
+ * @retval  True if the bus is currently active. False otherwise.
+ */
+bool WDC_IsBusActive(void)
+{
+  return wdcbus_active;
+}
+
+/**
+ * @brief   Run the frame callbacks deferred by the SS interrupt.
+ * @note    Call from the main loop.
+ * @retval  None.
+ */
+void WDC_PLLTask(void)
+{
+  //
+  // One Start-of-Frame callback per frame, even if several frames went
+  // by since the last call.
+  //
+  while (sof_handled != sof_count)
+  {
+    sof_handled++;
+
+    if (sof_callback)
+    {
+      sof_callback();
+    }
+  }
+
+  if (eof_callback && (WDC_RXQCount(&rx_queue) > 0))
+  {
+    eof_callback();
+  }
+}
+
+/**
+ * @brief   Stage a packet for the next bus frame.
+ * @note    Never blocks. The packet goes out during the next frame and
+ *          must stay valid until then (see WDC_PLLIsTransmitting()).
+ * @param   baud: Ignored. The base sets the SPI clock, so there is no
+ *          rate to switch.
+ * @retval  True if the packet was staged. False if it is too long or a
+ *          previous packet is still staged or being sent.
+ */
+bool WDC_PLLWritePacket(const uint8_t *packet, uint16_t len, uint8_t baud)
+{
+  uint8_t oldSREG;
+
+  (void)baud;
+
+  if ((len == 0) || (len > 255) || (packet == NULL) ||
+      (tx_state != WDC_PLL_TX_IDLE))
+  {
+    return false;
+  }
+
+  oldSREG = SREG;
+  cli();
+  tx_packet = packet;
+  tx_len = (uint8_t)len;
+  tx_count = 0;
+
+  //
+  // Between frames the length byte can go straight into SPDR. During a
+  // frame it is loaded at the end of the frame instead.
+  //
+  if (!wdcbus_active && WDC_GPIO<SS>::isHigh())
+  {
+    SPDR = tx_len;
+    tx_state = WDC_PLL_TX_STAGED;
+  }
+  else
+  {
+    tx_state = WDC_PLL_TX_PENDING;
+  }
+  SREG = oldSREG;
+
+  return true;
+}
+
+/**
+ * @brief   Check whether a packet is still staged or being sent.
+ * @retval  True until the frame that carries the last packet has ended.
+ */
+bool WDC_PLLIsTransmitting(void)
+{
+  return (tx_state != WDC_PLL_TX_IDLE);
+}
+
+/**
+ * @brief   Check whether a received frame is waiting to be read.
+ * @retval  True if an unread packet is available. False otherwise.
+ */
+bool WDC_PLLCanRead(void)
+{
+  return (WDC_RXQCount(&rx_queue) > 0);
+}
+
+/**
+ * @brief   Peek at the first byte of the packet.
+ * @retval  First byte of the packet of an unread packet is available.
+ *          -1 otherwise.
+ */
+int WDC_PLLPeek(void)
+{
+  uint8_t *frame;
+
+  return (WDC_RXQPeek(&rx_queue, &frame, NULL) > 0) ? frame[0] : -1;
+}
+
+/**
+ * @brief   Get a received packet (if one exists) from the physical layer.
+ * @param   packet: Destination buffer.
+ * @param   len: Size of the destination buffer.
+ * @retval  Number of bytes copied into the packet buffer.
+ */
+uint16_t WDC_PLLReadPacket(uint8_t *packet, uint16_t len)
+{
+  uint8_t *frame;
+  uint16_t frame_len = WDC_RXQPeek(&rx_queue, &frame, NULL);
+
+  if (len > frame_len)
+  {
+    len = frame_len;
+  }
+
+  memcpy(packet, frame, len);
+  WDC_PLLReleaseFrame();
+
+  return len;
+}
+
+/**
+ * @brief   Discard every received packet.
+ * @retval  None.
+ */
+void WDC_PLLFlushReadPacket(void)
+{
+  WDC_RXQFlush(&rx_queue);
+}
+
+/**
+ * @brief   Get the oldest received frame in place, without copying it.
+ * @param   frame: Set to point at the first byte of the frame.
+ * @param   timestamp: Set to the time the frame ended. May be NULL.
+ * @retval  Length of the frame. 0 if no frame is waiting.
+ */
+uint16_t WDC_PLLGetFrame(uint8_t **frame, uint32_t *timestamp)
+{
+  return WDC_RXQPeek(&rx_queue, frame, timestamp);
+}
+
+/**
+ * @brief   Hand the frame returned by WDC_PLLGetFrame() back to the PHY.
+ * @retval  None.
+ */
+void WDC_PLLReleaseFrame(void)
+{
+  WDC_RXQPop(&rx_queue);
+}
+
+/**
+ * @brief   Read the physical-link statistics.
+ * @note    tx_waits counts bytes the interrupt handler loaded too late
+ *          (SPI write collisions). rx_parity_errors and rx_flushes stay 0.
+ * @param   clear: Reset the counters after reading them.
+ * @retval  None.
+ */
+void WDC_PLLReadStats(pll_stats_t *stats, bool clear)
+{
+  uint8_t oldSREG = SREG;
+
+  cli();
+  *stats = pll_stats;
+  if (clear)
+  {
+    memset(&pll_stats, 0, sizeof(pll_stats));
+  }
+  SREG = oldSREG;
+}
+
+/**
+ * @brief   Current bus baud rate.
+ * @retval  Always WDC_PLL_BAUD_MASTER.
+ */
+uint8_t WDC_PLLGetBaud(void)
+{
+  return WDC_PLL_BAUD_MASTER;
+}
+
+/**
+ * @brief   Register the Start-of-Frame callback.
+ * @retval  None.
+ */
+void WDC_PLLRegisterStartOfFrameCallback(sof_callback_t cb)
+{
+  sof_callback = cb;
+}
+
+/**
+ * @brief   Register the End-of-Frame callback.
+ * @retval  None.
+ */
+void WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb)
+{
+  eof_callback = cb;
+}
+
+/* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   SS fell: open the receive frame and start sending the staged
+ *          packet, whose length byte is already in SPDR.
+ * @retval  None.
+ */
+static void WDC_PLLStartOfFrame(void)
+{
+  WDC_TRACE_EVENT(WDC_TRACE_SOF, 0);
+  wdcbus_active = true;
+  WDC_GPIO<MISO>::output();
+
+  rx_frame = WDC_RXQBeginFrame(&rx_queue);
+  if (rx_frame == NULL)
+  {
+    WDC_STAT_INC(pll_stats.rx_frames_dropped);
+  }
+  rx_len = 0;
+  rx_count = 0;
+
+  if (tx_state == WDC_PLL_TX_STAGED)
+  {
+    WDC_TRACE_EVENT(WDC_TRACE_TX_START, 0);
+    tx_state = WDC_PLL_TX_SENDING;
+  }
+
+  sof_count++;
+}
+
+/**
+ * @brief   SS rose: publish the received packet and get SPDR ready for
+ *          the next frame.
+ * @retval  None.
+ */
+static void WDC_PLLEndOfFrame(void)
+{
+  uint8_t len = 0;
+
+  wdcbus_active = false;
+  WDC_GPIO<MISO>::input();
+
+  if (rx_frame != NULL)
+  {
+    //
+    // Packet bytes are those after the length byte, up to the announced
+    // length and what fits.
+    //
+    if (rx_count > 1)
+    {
+      len = rx_count - 1;
+      if (len > rx_len)
+      {
+        len = rx_len;
+      }
+      if (len > WDC_PLL_MAX_FRAME_SIZE)
+      {
+        len = WDC_PLL_MAX_FRAME_SIZE;
+      }
+    }
+
+    WDC_TRACE_EVENT(WDC_TRACE_EOF, len);
+    WDC_RXQEndFrame(&rx_queue, len, micros());
+    rx_frame = NULL;
+
+    if (len > 0)
+    {
+      WDC_STAT_INC(pll_stats.rx_frames);
+    }
+    else
+    {
+      WDC_STAT_INC(pll_stats.rx_empty_frames);
+    }
+  }
+
+  //
+  // The packet went out with this frame. If the base stopped clocking
+  // early the rest is lost; the transport layer resends it.
+  //
+  if (tx_state == WDC_PLL_TX_SENDING)
+  {
+    WDC_TRACE_EVENT(WDC_TRACE_TX_COMPLETE, 0);
+    tx_state = WDC_PLL_TX_IDLE;
+  }
+
+  if (tx_state == WDC_PLL_TX_PENDING)
+  {
+    SPDR = tx_len;
+    tx_state = WDC_PLL_TX_STAGED;
+  }
+  else
+  {
+    SPDR = 0;
+  }
+}
+
+/**
+ * @brief   SS pin-change interrupt. Every SPI slave pin is on PCINT0 on
+ *          the supported boards.
+ * @retval  None.
+ */
+ISR(PCINT0_vect)
+{
+  bool low = !WDC_GPIO<SS>::isHigh();
+
+  //
+  // Other pins on the same port also land here. Only act on SS edges.
+  //
+  if (low && !wdcbus_active)
+  {
+    WDC_PLLStartOfFrame();
+  }
+  else if (!low && wdcbus_active)
+  {
+    WDC_PLLEndOfFrame();
+  }
+}
+
+/**
+ * @brief   SPI transfer complete interrupt. One byte in, one byte out.
+ * @retval  None.
+ */
+ISR(SPI_STC_vect)
+{
+  uint8_t c = SPDR;
+  uint8_t count = rx_count;
+
+  //
+  // The next byte out must be in SPDR before the base clocks again, so
+  // load it first.
+  //
+  if ((tx_state == WDC_PLL_TX_SENDING) && (tx_count < tx_len))
+  {
+    SPDR = tx_packet[tx_count++];
+  }
+  else
+  {
+    SPDR = WDC_SPI_FILL;
+  }
+  if (SPSR & _BV(WCOL))
+  {
+    WDC_STAT_INC(pll_stats.tx_waits);
+  }
+
+  //
+  // Byte 0 is the length of the base's packet. The packet follows; any
+  // bytes after it are padding.
+  //
+  if (count == 0)
+  {
+    WDC_TRACE_EVENT(WDC_TRACE_RX_FIRST_BYTE, 0);
+    rx_len = c;
+  }
+  else if (count <= rx_len)
+  {
+    if (count > WDC_PLL_MAX_FRAME_SIZE)
+    {
+      WDC_STAT_INC(pll_stats.rx_overruns);
+    }
+    else if (rx_frame != NULL)
+    {
+      rx_frame[count - 1] = c;
+    }
+  }
+
+  if (count != 0xFF)
+  {
+    rx_count = count + 1;
+  }
+}
+
+#endif /* WDC_PHY == WDC_PHY_SPI */
+
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -0,0 +1,94 @@
+/**
+  ******************************************************************************
+  * @file    wdcspi_physical.h
+  * @author  Alex Hsieh
+  * @version V0.0.1
+  * @date    18-Sep-2014
+  * @brief   Wearable Device Companion (WDC) physical-link layer (PHY) for the
+  *          WDC communication protocol (SPI slave).
+  *
+  *          The base is the SPI master and holds SS low for the whole of a
+  *          bus frame. In each direction a frame carries a length byte and
+  *          then that many packet bytes, and SPI shifts both directions at
+  *          once: the base keeps clocking until its own packet and the
+  *          companion's are both through, and the shorter side is padded
+  *          with 0x00. A length of 0 means no packet.
+  *
+  *          The base sets the clock, at most F_CPU / 4. Every byte is
+  *          handled by an interrupt, so the base must also leave about
+  *          WDC_SPI_BYTE_GAP_US after SS falls and between bytes.
+  *
+  *          SS is watched with its pin-change interrupt (PCINT0 on the
+  *          usual boards), which this PHY takes over.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 Illogical OR</center></h2>
+  *
+  *
+  ******************************************************************************
+  */
+
+#ifndef __WDCSPI_PHYSICAL_H__
+#define __WDCSPI_PHYSICAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include "wdc_rxqueue.h"
+#include "wdc_physical.h"
+
+/* Defines ------------------------------------------------------------------ */
+// Largest frame the PHY will receive, not counting the length byte. Bytes
+// beyond this are dropped.
+#define WDC_PLL_MAX_FRAME_SIZE  WDC_RXQ_MAX_FRAME_SIZE
+
+// SPI mode (clock polarity and phase). Both ends must agree.
+#ifndef WDC_SPI_MODE
+#define WDC_SPI_MODE            0
+#endif
+
+// Time the base should allow the interrupt handler per byte.
+#define WDC_SPI_BYTE_GAP_US     4
+
+//
+// Bus Baud Rates
+// The base sets the SPI clock, so there is a single index and nothing to
+// negotiate.
+//
+#define WDC_PLL_BAUD_MASTER     0
+#define WDC_PLL_BAUD_COUNT      1
+#define WDC_PLL_BAUD_DEFAULT    WDC_PLL_BAUD_MASTER
+#define WDC_PLL_BAUD_SUPPORTED  (1 << WDC_PLL_BAUD_MASTER)
+
+/* Function Prototypes ------------------------------------------------------ */
+void  WDC_PLLInit(void);
+void  WDC_PLLDeinit(void);
+bool  WDC_IsBusActive(void);
+void  WDC_PLLTask(void);
+bool  WDC_PLLWritePacket(const uint8_t *packet, uint16_t len, uint8_t baud);
+bool  WDC_PLLIsTransmitting(void);
+bool  WDC_PLLCanRead(void);
+int   WDC_PLLPeek(void);
+uint16_t WDC_PLLReadPacket(uint8_t *packet, uint16_t len);
+void  WDC_PLLFlushReadPacket(void);
+uint16_t WDC_PLLGetFrame(uint8_t **frame, uint32_t *timestamp);
+void  WDC_PLLReleaseFrame(void);
+void  WDC_PLLReadStats(pll_stats_t *stats, bool clear);
+uint8_t WDC_PLLGetBaud(void);
+
+void  WDC_PLLRegisterStartOfFrameCallback(sof_callback_t cb);
+void  WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WDCSPI_PHYSICAL_H__ */
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+
@@ -18,151 +18,575 @@
 
 
 /* Includes ----------------------------------------------------------------- */
-#include <string.h>
 #include "Arduino.h"
+#include "wdc_physical.h"
+
+// Only built when this is the selected PHY (see wdc_physical.h).
+#if (WDC_PHY == WDC_PHY_UART)
+
+#include <string.h>
 #include "wdcuart_physical.h"
+#include "wdc_gpio.h"
+#include "wdc_trace.h"
 
 /* Defines ------------------------------------------------------------------ */
-// UART Baudrate Settings
-#if ((F_CPU / 16UL) < WDC_UART_BAUD)
-#error "WDC Buadrate is not supported on this device."
-#endif
+// Rate of a baud rate index, e.g. WDC_PLL_BAUD_RATE(WDC_PLL_BAUD_DEFAULT).
+#define WDC_PLL_BAUD_RATE(baud)   WDC_PLL_BAUD_RATE_(baud)
+#define WDC_PLL_BAUD_RATE_(baud)  WDC_PLL_BAUD_RATE_##baud
+
+//
+// Compile-time check. Fails with a negative array size if cond is false.
+//
+#define WDC_PLL_STATIC_ASSERT(cond, name) \
+  typedef char wdc_pll_static_assert_##name[(cond) ? 1 : -1]
+
+//
+// WDC_PLL_BAUD_SUPPORTED is worked out by the preprocessor so C files can
+// use it. Make sure it agrees with the UBRR settings the UART really gets.
+//
+#define WDC_PLL_BAUD_CHECK(n) \
+  WDC_PLL_STATIC_ASSERT(!!(WDC_PLL_BAUD_SUPPORTED & (1 << (n))) == \
+                        (SerialBaudSetting<WDC_PLL_BAUD_RATE_##n>::u2x && \
+                         (SerialBaudSetting<WDC_PLL_BAUD_RATE_##n>::error_permille <= \
+                          WDC_UART_BAUD_TOLERANCE)), baud_supported_##n)
+
+WDC_PLL_BAUD_CHECK(0);
+WDC_PLL_BAUD_CHECK(1);
+WDC_PLL_BAUD_CHECK(2);
+WDC_PLL_BAUD_CHECK(3);
 
 #ifndef NULL
 #define NULL  ((void *)0)
 #endif
 
+//
+// External Interrupt Maps
+// attachInterrupt() number of each pin that has one, as numbered by the
+// core. Older cores have no digitalPinToInterrupt(), so the supported
+// boards are mapped here and checked at compile time; other boards fall
+// back to digitalPinToInterrupt() where the core has it.
+//
+#define WDC_PLL_EN_NO_INTERRUPT   0xFF
+
+#if defined(__AVR_ATmega8__) || defined(__AVR_ATmega88__) || \
+    defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || \
+    defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
+#define WDC_PLL_EN_INTERRUPT(pin) \
+  ((pin) == 2 ? 0 : (pin) == 3 ? 1 : WDC_PLL_EN_NO_INTERRUPT)
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define WDC_PLL_EN_INTERRUPT(pin) \
+  ((pin) == 2 ? 0 : (pin) == 3 ? 1 : (pin) == 21 ? 2 : (pin) == 20 ? 3 : \
+   (pin) == 19 ? 4 : (pin) == 18 ? 5 : WDC_PLL_EN_NO_INTERRUPT)
+#elif defined(__AVR_ATmega32U4__)
+#define WDC_PLL_EN_INTERRUPT(pin) \
+  ((pin) == 3 ? 0 : (pin) == 2 ? 1 : (pin) == 0 ? 2 : (pin) == 1 ? 3 : \
+   (pin) == 7 ? 4 : WDC_PLL_EN_NO_INTERRUPT)
+#elif defined(digitalPinToInterrupt)
+#define WDC_PLL_EN_INTERRUPT(pin) digitalPinToInterrupt(pin)
+#define WDC_PLL_EN_UNCHECKED
+#else
+#error "No external interrupt map for this board. Add one above."
+#define WDC_PLL_EN_UNCHECKED
+#endif
+
+#if !defined(WDC_PLL_EN_UNCHECKED)
+#if (WDC_PLL_EN_INTERRUPT(WDC_PLL_BUS0_EN_PIN) == WDC_PLL_EN_NO_INTERRUPT)
+#error "WDC_PLL_BUS0_EN_PIN has no external interrupt on this board."
+#endif
+#if (WDC_PLL_BUS_COUNT > 1) && \
+    (WDC_PLL_EN_INTERRUPT(WDC_PLL_BUS1_EN_PIN) == WDC_PLL_EN_NO_INTERRUPT)
+#error "WDC_PLL_BUS1_EN_PIN has no external interrupt on this board."
+#endif
+#if (WDC_PLL_BUS_COUNT > 2) && \
+    (WDC_PLL_EN_INTERRUPT(WDC_PLL_BUS2_EN_PIN) == WDC_PLL_EN_NO_INTERRUPT)
+#error "WDC_PLL_BUS2_EN_PIN has no external interrupt on this board."
+#endif
+#if (WDC_PLL_BUS_COUNT > 3) && \
+    (WDC_PLL_EN_INTERRUPT(WDC_PLL_BUS3_EN_PIN) == WDC_PLL_EN_NO_INTERRUPT)
+#error "WDC_PLL_BUS3_EN_PIN has no external interrupt on this board."
+#endif
+#endif
+
+// Transmit states. A packet is staged in the UART transmit buffer while
+// the bus is idle and released by the next Start-of-Frame interrupt.
+#define WDC_PLL_TX_IDLE         0
+#define WDC_PLL_TX_STAGED       1
+#define WDC_PLL_TX_SENDING      2
+
+/* Private Types ------------------------------------------------------------ */
+//
+// Everything one bus needs. The interrupt handlers for bus n are
+// instantiated with n and its WDC_EN pin, so they reach their context
+// without a lookup and the pin through WDC_GPIO.
+//
+typedef struct
+{
+  HardwareSerial            *serial;
+  volatile bool             active;
+  wdc_rxqueue_t             rx_queue;
+  uint8_t                   *rx_frame;
+  const uint8_t * volatile  tx_packet;
+  volatile uint16_t         tx_remaining;
+  volatile uint8_t          tx_state;
+  volatile uint8_t          tx_baud;
+  volatile uint8_t          sof_count;
+  uint8_t                   sof_handled;
+  sof_callback_t            sof_callback;
+  eof_callback_t            eof_callback;
+  pll_stats_t               stats;
+  uint8_t                   baud;
+  volatile uint8_t          baud_next;
+} pll_bus_t;
+
 /* Private Variables -------------------------------------------------------- */
-static volatile bool wdcbus_active = false;
-static sof_callback_t sof_callback = NULL;
-static eof_callback_t eof_callback = NULL;
+static pll_bus_t pll_buses[WDC_PLL_BUS_COUNT];
+
+//
+// UBRR settings (U2X mode) for each baud rate index, worked out at compile
+// time so a switch costs the interrupt handler two register writes.
+//
+static const uint16_t pll_baud_ubrr[WDC_PLL_BAUD_COUNT] =
+{
+  SerialBaudSetting<WDC_PLL_BAUD_RATE_0>::ubrr,
+  SerialBaudSetting<WDC_PLL_BAUD_RATE_1>::ubrr,
+  SerialBaudSetting<WDC_PLL_BAUD_RATE_2>::ubrr,
+  SerialBaudSetting<WDC_PLL_BAUD_RATE_3>::ubrr,
+};
 
 /* Private Function Prototypes ---------------------------------------------- */
-static void WDC_PLLEnableBus(void);
-static void WDC_PLLDisableBus(void);
-static void WDC_PLLIntHandler(void);
-static void WDC_PLLTransmitCompleteHandler(void);
+template <uint8_t BUS, uint8_t EN_PIN>
+static void WDC_PLLBusInit(HardwareSerial *serial);
+template <uint8_t BUS, uint8_t EN_PIN> static void WDC_PLLBusDeinit(void);
+template <uint8_t BUS, uint8_t EN_PIN> static void WDC_PLLIntHandler(void);
+template <uint8_t BUS> static void WDC_PLLTransmitSpaceHandler(void);
+template <uint8_t BUS, uint8_t EN_PIN> static void WDC_PLLTransmitCompleteHandler(void);
+template <uint8_t EN_PIN> static void WDC_PLLEnableBus(void);
+template <uint8_t EN_PIN> static void WDC_PLLDisableBus(void);
+template <uint8_t EN_PIN> static void WDC_PLLBusIntHandler(pll_bus_t *bus);
+static void WDC_PLLBusTransmitSpace(pll_bus_t *bus);
+template <uint8_t EN_PIN> static void WDC_PLLBusTransmitComplete(pll_bus_t *bus);
+#if WDC_TRACE
+static void WDC_PLLReceiveStartHandler(void);
+#endif
 
 /* Function Definitions ----------------------------------------------------- */
 /**
  * @brief   Initialize the physical-link layer for the WDC UART communication
  *          protocol.
+ * @note    Brings up every configured bus (see WDC_PLL_BUS_COUNT).
  * @retval  None.
  */
 void WDC_PLLInit(void)
 {
-  //
-  // Initialize the WDC_EN pin.
-  // The interrupt should be set for both edges.
-  //
-  pinMode(WDC_EN_PIN, INPUT_PULLUP);
-  attachInterrupt(WDC_EN_PIN, WDC_PLLIntHandler, CHANGE);
-
-  //
-  // Attach handler for when UART transmits complete.
-  //
-  Serial.attachTransmitCompleteHandler(WDC_PLLTransmitCompleteHandler);
+#if WDC_TRACE
+  WDC_TraceInit();
+#endif
 
-  //
-  // Initialize the UART to the default baud rate.  
-  //
-  Serial.begin(WDC_UART_BAUD);
+  WDC_PLLBusInit<0, WDC_PLL_BUS0_EN_PIN>(&WDC_PLL_BUS0_SERIAL);
+#if (WDC_PLL_BUS_COUNT > 1)
+  WDC_PLLBusInit<1, WDC_PLL_BUS1_EN_PIN>(&WDC_PLL_BUS1_SERIAL);
+#endif
+#if (WDC_PLL_BUS_COUNT > 2)
+  WDC_PLLBusInit<2, WDC_PLL_BUS2_EN_PIN>(&WDC_PLL_BUS2_SERIAL);
+#endif
+#if (WDC_PLL_BUS_COUNT > 3)
+  WDC_PLLBusInit<3, WDC_PLL_BUS3_EN_PIN>(&WDC_PLL_BUS3_SERIAL);
+#endif
 }
 
 /**
  * @brief   De-initialize the physical-link layer for the WDC UART communication
  *          protocol.
+ * @note    Takes down every configured bus. A packet still staged is
+ *          dropped and received frames not yet read are discarded.
  * @retval  None.
  */
 void WDC_PLLDeinit(void)
 {
-  // TODO
+  WDC_PLLBusDeinit<0, WDC_PLL_BUS0_EN_PIN>();
+#if (WDC_PLL_BUS_COUNT > 1)
+  WDC_PLLBusDeinit<1, WDC_PLL_BUS1_EN_PIN>();
+#endif
+#if (WDC_PLL_BUS_COUNT > 2)
+  WDC_PLLBusDeinit<2, WDC_PLL_BUS2_EN_PIN>();
+#endif
+#if (WDC_PLL_BUS_COUNT > 3)
+  WDC_PLLBusDeinit<3, WDC_PLL_BUS3_EN_PIN>();
+#endif
 }
 
 /**
- * @brief   Check whether the WDC bus is active or not.
+ * @brief   Run the frame callbacks deferred by the WDC_EN interrupts.
+ * @note    Call from the main loop. The interrupt handlers only queue
+ *          received frames and count Start-of-Frame edges, so the
+ *          callbacks never run with interrupts masked.
+ * @retval  None.
+ */
+void WDC_PLLTask(void)
+{
+  pll_bus_t *bus;
+  uint8_t i;
+
+  for (i = 0; i < WDC_PLL_BUS_COUNT; i++)
+  {
+    bus = &pll_buses[i];
+
+    //
+    // One Start-of-Frame callback per frame, even if several frames went
+    // by since the last call.
+    //
+    while (bus->sof_handled != bus->sof_count)
+    {
+      bus->sof_handled++;
+
+      if (bus->sof_callback)
+      {
+        bus->sof_callback();
+      }
+    }
+
+    if (bus->eof_callback && (WDC_RXQCount(&bus->rx_queue) > 0))
+    {
+      bus->eof_callback();
+    }
+  }
+}
+
+/**
+ * @brief   Check whether a WDC bus is active or not.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
  * @retval  True if the bus is currently active. False otherwise.
  */
-bool WDC_IsBusActive(void)
+bool WDC_PLLBusIsActive(uint8_t bus)
 {
-  return wdcbus_active;
+  return pll_buses[bus].active;
 }
 
 /**
- * @brief   
- * @retval  None.
+ * @brief   Stage a packet for the next frame on a bus.
+ * @note    Never blocks. As much of the packet as fits goes into the UART
+ *          transmit buffer now, with the transmitter held; the next
+ *          Start-of-Frame interrupt releases it and the rest follows from
+ *          the UART's transmit space handler. The packet must stay valid
+ *          until the transfer completes (see WDC_PLLBusIsTransmitting()).
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @param   baud: Baud rate index (WDC_PLL_BAUD_xxx) to switch to at the
+ *          end of the frame that sends the packet, or WDC_PLL_BAUD_NONE.
+ *          Ignored unless it is in WDC_PLL_BAUD_SUPPORTED.
+ * @retval  True if the packet was staged. False if a previous packet is
+ *          still staged or being sent.
  */
-void WDC_PLLWritePacket(uint8_t *packet, uint16_t len)
+bool WDC_PLLBusWritePacket(uint8_t bus, const uint8_t *packet, uint16_t len,
+                           uint8_t baud)
 {
-  if (wdcbus_active && (len > 0) && (packet != NULL))
+  pll_bus_t *b = &pll_buses[bus];
+  uint8_t oldSREG;
+
+  if ((len == 0) || (packet == NULL) || (b->tx_state != WDC_PLL_TX_IDLE))
+  {
+    return false;
+  }
+  if ((baud >= WDC_PLL_BAUD_COUNT) || !(WDC_PLL_BAUD_SUPPORTED & (1 << baud)))
   {
-    WDC_PLLEnableBus();
-    Serial.write(packet, len);
+    baud = WDC_PLL_BAUD_NONE;
   }
+
+  //
+  // Hand the packet over with interrupts masked so the ISRs never see a
+  // half-updated transfer, or a packet without its baud rate switch.
+  //
+  oldSREG = SREG;
+  cli();
+  b->serial->holdTransmit();
+  b->tx_packet = packet;
+  b->tx_remaining = len;
+  b->tx_baud = baud;
+  b->tx_state = WDC_PLL_TX_STAGED;
+  WDC_PLLBusTransmitSpace(b);
+  SREG = oldSREG;
+
+  return true;
 }
 
 /**
- * @brief   
+ * @brief   Check whether a packet is still staged or being sent on a bus.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @retval  True until the last byte of the packet has been sent.
+ */
+bool WDC_PLLBusIsTransmitting(uint8_t bus)
+{
+  return (pll_buses[bus].tx_state != WDC_PLL_TX_IDLE);
+}
+
+/**
+ * @brief   Check whether a received frame is waiting to be read.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
  * @retval  True if an unread packet is available. False otherwise.
  */
-bool WDC_PLLCanRead(void)
+bool WDC_PLLBusCanRead(uint8_t bus)
 {
-  return (Serial.available() > 0);
+  return (WDC_RXQCount(&pll_buses[bus].rx_queue) > 0);
 }
 
 /**
  * @brief   Peek at the first byte of the packet.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
  * @retval  First byte of the packet of an unread packet is available.
  *          -1 otherwise.
  */
-int WDC_PLLPeek(void)
+int WDC_PLLBusPeek(uint8_t bus)
 {
-  return Serial.peek();
+  uint8_t *frame;
+
+  return (WDC_RXQPeek(&pll_buses[bus].rx_queue, &frame, NULL) > 0) ? frame[0] : -1;
 }
 
 /**
  * @brief   Get a received packet (if one exists) from the physical layer.
- * @retval  None.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @param   packet: Destination buffer.
+ * @param   len: Size of the destination buffer.
+ * @retval  Number of bytes copied into the packet buffer.
  */
-bool WDC_PLLReadPacket(uint8_t *packet)
+uint16_t WDC_PLLBusReadPacket(uint8_t bus, uint8_t *packet, uint16_t len)
 {
-  if (WDC_PLLCanRead())
+  uint8_t *frame;
+  uint16_t frame_len = WDC_RXQPeek(&pll_buses[bus].rx_queue, &frame, NULL);
+
+  if (len > frame_len)
   {
-    Serial.readBytes((char *)packet, Serial.available());
-    return true;
+    len = frame_len;
   }
 
-  return false;
+  memcpy(packet, frame, len);
+  WDC_PLLBusReleaseFrame(bus);
+
+  return len;
+}
+
+/**
+ * @brief   Discard every received packet and any stray bytes.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @retval  None.
+ */
+void WDC_PLLBusFlushReadPacket(uint8_t bus)
+{
+  WDC_RXQFlush(&pll_buses[bus].rx_queue);
+  pll_buses[bus].serial->flushReceiveBuffer();
+}
+
+/**
+ * @brief   Get the oldest received frame in place, without copying it.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @param   frame: Set to point at the first byte of the frame.
+ * @param   timestamp: Set to the time the frame ended. May be NULL.
+ * @retval  Length of the frame. 0 if no frame is waiting.
+ */
+uint16_t WDC_PLLBusGetFrame(uint8_t bus, uint8_t **frame, uint32_t *timestamp)
+{
+  return WDC_RXQPeek(&pll_buses[bus].rx_queue, frame, timestamp);
 }
 
 /**
- * @brief   
+ * @brief   Hand the frame returned by WDC_PLLBusGetFrame() back to the PHY.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
  * @retval  None.
  */
-void  WDC_PLLFlushReadPacket(void)
+void WDC_PLLBusReleaseFrame(uint8_t bus)
 {
-  Serial.flushReceiveBuffer();
+  WDC_RXQPop(&pll_buses[bus].rx_queue);
 }
 
 /**
- * @brief   Register the Start-of-Frame callback.
+ * @brief   Read the physical-link statistics of a bus, including its UART's.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @param   clear: Reset the counters after reading them.
  * @retval  None.
  */
-void WDC_PLLRegisterStartOfFrameCallback(eof_callback_t cb)
+void WDC_PLLBusReadStats(uint8_t bus, pll_stats_t *stats, bool clear)
 {
-  sof_callback = cb;
+  pll_bus_t *b = &pll_buses[bus];
+  serial_stats uart;
+  uint8_t oldSREG;
+
+  b->serial->readStats(&uart, clear);
+
+  //
+  // The WDC_EN interrupt updates the frame counters.
+  //
+  oldSREG = SREG;
+  cli();
+  *stats = b->stats;
+  if (clear)
+  {
+    memset(&b->stats, 0, sizeof(b->stats));
+  }
+  SREG = oldSREG;
+
+  stats->rx_overruns = uart.rx_overruns;
+  stats->rx_parity_errors = uart.rx_parity_errors;
+  stats->tx_waits = uart.tx_waits;
 }
 
 /**
- * @brief   Register the End-of-Frame callback.
+ * @brief   Current baud rate of a bus.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @retval  Baud rate index (WDC_PLL_BAUD_xxx).
+ */
+uint8_t WDC_PLLBusGetBaud(uint8_t bus)
+{
+  return pll_buses[bus].baud;
+}
+
+/**
+ * @brief   Register the Start-of-Frame callback of a bus.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
  * @retval  None.
  */
-void WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb)
+void WDC_PLLBusRegisterStartOfFrameCallback(uint8_t bus, sof_callback_t cb)
 {
-  eof_callback = cb;
+  pll_buses[bus].sof_callback = cb;
+}
+
+/**
+ * @brief   Register the End-of-Frame callback of a bus.
+ * @param   bus: Bus index, less than WDC_PLL_BUS_COUNT.
+ * @retval  None.
+ */
+void WDC_PLLBusRegisterEndOfFrameCallback(uint8_t bus, eof_callback_t cb)
+{
+  pll_buses[bus].eof_callback = cb;
 }
 
 /* Private Function Definitions --------------------------------------------- */
+/**
+ * @brief   Bring up one bus: its WDC_EN pin, its UART and their handlers.
+ * @note    EN_PIN is the WDC_EN pin of the bus. It must have an external
+ *          interrupt.
+ * @param   serial: UART carrying the bus.
+ * @retval  None.
+ */
+template <uint8_t BUS, uint8_t EN_PIN>
+static void WDC_PLLBusInit(HardwareSerial *serial)
+{
+  pll_bus_t *bus = &pll_buses[BUS];
+
+  bus->serial = serial;
+  bus->active = false;
+  bus->rx_frame = NULL;
+  bus->tx_packet = NULL;
+  bus->tx_remaining = 0;
+  bus->tx_state = WDC_PLL_TX_IDLE;
+  bus->tx_baud = WDC_PLL_BAUD_NONE;
+  bus->sof_handled = bus->sof_count;
+  bus->baud = WDC_PLL_BAUD_DEFAULT;
+  bus->baud_next = WDC_PLL_BAUD_NONE;
+  WDC_RXQInit(&bus->rx_queue);
+
+  //
+  // Initialize the WDC_EN pin.
+  // The interrupt should be set for both edges.
+  //
+  WDC_GPIO<EN_PIN>::release();
+  attachInterrupt(WDC_PLL_EN_INTERRUPT(EN_PIN), WDC_PLLIntHandler<BUS, EN_PIN>, CHANGE);
+
+  //
+  // Attach handler for when UART transmits complete.
+  //
+  serial->attachTransmitCompleteHandler(WDC_PLLTransmitCompleteHandler<BUS, EN_PIN>);
+  serial->attachTransmitSpaceHandler(WDC_PLLTransmitSpaceHandler<BUS>);
+
+#if WDC_TRACE
+  //
+  // Trace the first byte of each frame. Only seen with zero-copy receive.
+  //
+  serial->attachReceiveStartHandler(WDC_PLLReceiveStartHandler);
+#endif
+
+  //
+  // Initialize the UART to the default baud rate.  
+  //
+  serial->begin<WDC_PLL_BAUD_RATE(WDC_PLL_BAUD_DEFAULT)>();
+}
+
+/**
+ * @brief   Take down one bus brought up by WDC_PLLBusInit().
+ * @retval  None.
+ */
+template <uint8_t BUS, uint8_t EN_PIN>
+static void WDC_PLLBusDeinit(void)
+{
+  pll_bus_t *bus = &pll_buses[BUS];
+  HardwareSerial *serial = bus->serial;
+  uint8_t oldSREG;
+
+  //
+  // Stop the WDC_EN interrupt first so no frame opens or closes while
+  // the rest comes down.
+  //
+  detachInterrupt(WDC_PLL_EN_INTERRUPT(EN_PIN));
+
+  oldSREG = SREG;
+  cli();
+  serial->detachReceiveTarget();
+  serial->attachTransmitCompleteHandler(NULL);
+  serial->attachTransmitSpaceHandler(NULL);
+#if WDC_TRACE
+  serial->attachReceiveStartHandler(NULL);
+#endif
+  SREG = oldSREG;
+
+  //
+  // Stop the UART. A packet still held for the next frame is dropped.
+  // Then let go of WDC_EN, in case the bus was being held.
+  //
+  serial->end();
+  WDC_GPIO<EN_PIN>::input();
+
+  bus->active = false;
+  bus->rx_frame = NULL;
+  bus->tx_packet = NULL;
+  bus->tx_remaining = 0;
+  bus->tx_state = WDC_PLL_TX_IDLE;
+  bus->tx_baud = WDC_PLL_BAUD_NONE;
+  bus->sof_handled = bus->sof_count;
+  bus->sof_callback = NULL;
+  bus->eof_callback = NULL;
+  bus->baud = WDC_PLL_BAUD_DEFAULT;
+  bus->baud_next = WDC_PLL_BAUD_NONE;
+  WDC_RXQInit(&bus->rx_queue);
+}
+
+/**
+ * @brief   WDC_EN pin-change interrupt of bus BUS.
+ * @retval  None.
+ */
+template <uint8_t BUS, uint8_t EN_PIN>
+static void WDC_PLLIntHandler(void)
+{
+  WDC_PLLBusIntHandler<EN_PIN>(&pll_buses[BUS]);
+}
+
+/**
+ * @brief   UART transmit space handler of bus BUS.
+ * @retval  None.
+ */
+template <uint8_t BUS>
+static void WDC_PLLTransmitSpaceHandler(void)
+{
+  WDC_PLLBusTransmitSpace(&pll_buses[BUS]);
+}
+
+/**
+ * @brief   UART transmit complete handler of bus BUS.
+ * @retval  None.
+ */
+template <uint8_t BUS, uint8_t EN_PIN>
+static void WDC_PLLTransmitCompleteHandler(void)
+{
+  WDC_PLLBusTransmitComplete<EN_PIN>(&pll_buses[BUS]);
+}
+
 /**
  * @brief   Enable the bus.
  * @note    This is effective only if the bus is already active. Essentially,
@@ -170,10 +594,10 @@ void WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb)
  *          it is in the process of sending a packet.
  * @retval  None.
  */
+template <uint8_t EN_PIN>
 static void WDC_PLLEnableBus(void)
 {
-  digitalWrite(WDC_EN_PIN, LOW);
-  pinMode(WDC_EN_PIN, OUTPUT);
+  WDC_GPIO<EN_PIN>::driveLow();
 }
 
 /**
@@ -182,82 +606,182 @@ static void WDC_PLLEnableBus(void)
  *          has control of the bus.
  * @retval  None.
  */
+template <uint8_t EN_PIN>
 static void WDC_PLLDisableBus(void)
 {
-  pinMode(WDC_EN_PIN, INPUT_PULLUP);
+  WDC_GPIO<EN_PIN>::release();
 }
 
 /**
- * @brief   
+ * @brief   WDC_EN pin-change interrupt.
+ * @note    Top half only: opens or closes the receive frame, timestamps
+ *          it and releases the staged packet. The frame callbacks run
+ *          later from WDC_PLLTask().
  * @retval  None.
  */
-static void WDC_PLLIntHandler(void)
+template <uint8_t EN_PIN>
+static void WDC_PLLBusIntHandler(pll_bus_t *bus)
 {
+  HardwareSerial *serial = bus->serial;
+  uint8_t len = 0;
+
   //
   // If WDC Enable Pin is LOW, a falling edge was caught and the
   // WDC_BUS is active. If it is HIGH, a rising edge was caught and
   // the WDC_BUS is inactive. A single frame starts on a falling edge
-  // and ends on a rising edge.
+  // and ends on a rising edge. The pin is sampled once per edge.
   //
-  if (digitalRead(WDC_EN_PIN) == LOW)
+  if (!WDC_GPIO<EN_PIN>::isHigh())
   {
-    wdcbus_active = true;
+    WDC_TRACE_EVENT(WDC_TRACE_SOF, 0);
+    bus->active = true;
 
     //
-    // Start of frame detected. Flush the RX buffer and prep for
-    // receiving any data.
+    // Start of frame detected. Reserve room for the frame in the
+    // receive queue; earlier frames that have not been read yet stay
+    // queued. Drop any stray bytes received between frames.
     //
-    if (Serial.available() > 0)
+    bus->rx_frame = WDC_RXQBeginFrame(&bus->rx_queue);
+    if (bus->rx_frame == NULL)
+    {
+      WDC_STAT_INC(bus->stats.rx_frames_dropped);
+    }
+    if (serial->available() > 0)
     {
-      Serial.flushReceiveBuffer();
+      WDC_STAT_INC(bus->stats.rx_flushes);
+      serial->flushReceiveBuffer();
     }
 
+#if WDC_PLL_ZERO_COPY_RX
     //
-    // Service the Start-of-Frame callback.
+    // Have the UART RX ISR write the frame straight into the queue. If
+    // the queue is full, the frame lands in the ring and is dropped.
     //
-    if (sof_callback)
+    if (bus->rx_frame != NULL)
     {
-      sof_callback();
+      serial->attachReceiveTarget(bus->rx_frame, WDC_PLL_MAX_FRAME_SIZE);
     }
-  }
-  else if (digitalRead(WDC_EN_PIN) == HIGH)
-  {
-    wdcbus_active = false;
+#endif
 
     //
-    // End of frame detected. Store the received data.
+    // Start sending the staged packet and hold WDC_EN low until it is
+    // out, so the base does not close the frame under it.
     //
-    if (Serial.available() > 0)
+    if (bus->tx_state == WDC_PLL_TX_STAGED)
     {
+      WDC_TRACE_EVENT(WDC_TRACE_TX_START, 0);
+      WDC_PLLEnableBus<EN_PIN>();
+      bus->tx_state = WDC_PLL_TX_SENDING;
+      serial->releaseTransmit();
+
       //
-      // Service the End-of-Frame callback.
+      // A baud rate switch staged with the packet happens at the end of
+      // this frame.
       //
-      if (eof_callback)
+      bus->baud_next = bus->tx_baud;
+    }
+
+    bus->sof_count++;
+  }
+  else
+  {
+    bus->active = false;
+
+    //
+    // End of frame detected. Publish the received data.
+    //
+    if (bus->rx_frame != NULL)
+    {
+#if WDC_PLL_ZERO_COPY_RX
+      len = serial->detachReceiveTarget();
+#else
+      len = serial->readBlock(bus->rx_frame, WDC_PLL_MAX_FRAME_SIZE);
+#endif
+      WDC_TRACE_EVENT(WDC_TRACE_EOF, len);
+      WDC_RXQEndFrame(&bus->rx_queue, len, micros());
+      bus->rx_frame = NULL;
+
+      if (len > 0)
       {
-        eof_callback();
+        WDC_STAT_INC(bus->stats.rx_frames);
+      }
+      else
+      {
+        WDC_STAT_INC(bus->stats.rx_empty_frames);
       }
     }
-    else
+
+    //
+    // Anything that did not fit in the queue is invalid. Discard it.
+    //
+    if (serial->available() > 0)
     {
-      //
-      // Invalid packet received. Discard it.
-      //
-      Serial.flushReceiveBuffer();
+      WDC_STAT_INC(bus->stats.rx_flushes);
+      serial->flushReceiveBuffer();
+    }
+
+    //
+    // Switch baud rate once the packet announcing it is out. WDC_EN is
+    // held until the stop bit of its last byte, so the UART is idle by
+    // the time the frame can end.
+    //
+    if (bus->baud_next != WDC_PLL_BAUD_NONE)
+    {
+      serial->setBaudSetting(pll_baud_ubrr[bus->baud_next], true);
+      bus->baud = bus->baud_next;
+      bus->baud_next = WDC_PLL_BAUD_NONE;
     }
   }
 }
 
 /**
- * @brief   
+ * @brief   Move more of the pending packet into the UART transmit buffer.
+ * @note    Called from the UART's UDRE ISR when its buffer has drained.
  * @retval  None.
  */
-static void WDC_PLLTransmitCompleteHandler(void)
+static void WDC_PLLBusTransmitSpace(pll_bus_t *bus)
+{
+  uint16_t sent;
+
+  if (bus->tx_remaining > 0)
+  {
+    sent = bus->serial->tryWrite(bus->tx_packet, bus->tx_remaining);
+    bus->tx_packet += sent;
+    bus->tx_remaining -= sent;
+  }
+}
+
+/**
+ * @brief   Release the bus once the packet has been sent.
+ * @note    Called from the UART's TXC ISR, after the stop bit of the last
+ *          byte, so the base can close the frame as soon as WDC_EN rises.
+ * @retval  None.
+ */
+template <uint8_t EN_PIN>
+static void WDC_PLLBusTransmitComplete(pll_bus_t *bus)
 {
   //
-  // Release the WDC_EN pin.
+  // Release the WDC_EN pin once the whole packet has been sent.
   //
-  WDC_PLLDisableBus();
+  if ((bus->tx_state == WDC_PLL_TX_SENDING) && (bus->tx_remaining == 0))
+  {
+    WDC_TRACE_EVENT(WDC_TRACE_TX_COMPLETE, 0);
+    bus->tx_state = WDC_PLL_TX_IDLE;
+    WDC_PLLDisableBus<EN_PIN>();
+  }
 }
 
-/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
+#if WDC_TRACE
+/**
+ * @brief   Called from the UART RX ISR for the first byte of a frame.
+ * @retval  None.
+ */
+static void WDC_PLLReceiveStartHandler(void)
+{
+  WDC_TRACE_EVENT(WDC_TRACE_RX_FIRST_BYTE, 0);
+}
+#endif
+
+#endif /* WDC_PHY == WDC_PHY_UART */
 
+/****************** (C) COPYRIGHT Illogical OR *****************END OF FILE****/
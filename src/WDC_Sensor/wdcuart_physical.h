@@ -26,34 +26,217 @@ extern "C" {
 /* Includes ----------------------------------------------------------------- */
 #include <stdint.h>
 #include <stdbool.h>
+#include "wdc_rxqueue.h"
+#include "wdc_physical.h"
 
 /* Defines ------------------------------------------------------------------ */
-// WDC_EN Pin
-#define WDC_EN_PIN              2
+//
+// Bus Configuration
+// Each bus is a hardware UART plus a WDC_EN pin on an external interrupt,
+// with its own receive queue, transmit state and baud rate. The data-link
+// layer runs on bus 0; any further buses are driven through the
+// WDC_PLLBusxxx() functions, e.g. to serve several bases from one Mega, or
+// set WDC_PLL_BUS0_SERIAL to Serial1 to keep Serial free for debug output.
+//
+#ifndef WDC_PLL_BUS_COUNT
+#define WDC_PLL_BUS_COUNT       1
+#endif
+
+#ifndef WDC_PLL_BUS0_SERIAL
+#define WDC_PLL_BUS0_SERIAL     Serial
+#endif
+#ifndef WDC_PLL_BUS0_EN_PIN
+#define WDC_PLL_BUS0_EN_PIN     2
+#endif
+#ifndef WDC_PLL_BUS1_SERIAL
+#define WDC_PLL_BUS1_SERIAL     Serial1
+#endif
+#ifndef WDC_PLL_BUS1_EN_PIN
+#define WDC_PLL_BUS1_EN_PIN     3
+#endif
+#ifndef WDC_PLL_BUS2_SERIAL
+#define WDC_PLL_BUS2_SERIAL     Serial2
+#endif
+#ifndef WDC_PLL_BUS2_EN_PIN
+#define WDC_PLL_BUS2_EN_PIN     21
+#endif
+#ifndef WDC_PLL_BUS3_SERIAL
+#define WDC_PLL_BUS3_SERIAL     Serial3
+#endif
+#ifndef WDC_PLL_BUS3_EN_PIN
+#define WDC_PLL_BUS3_EN_PIN     20
+#endif
+
+#if (WDC_PLL_BUS_COUNT < 1) || (WDC_PLL_BUS_COUNT > 4)
+#error "WDC_PLL_BUS_COUNT must be between 1 and 4."
+#endif
+
+// Largest frame the PHY will receive. Bytes beyond this are dropped.
+#define WDC_PLL_MAX_FRAME_SIZE  WDC_RXQ_MAX_FRAME_SIZE
+
+// Receive mode. When set, the UART RX ISR deposits a frame's bytes straight
+// into the PHY frame buffer between SOF and EOF. When cleared, bytes go
+// through the HardwareSerial ring and are copied out at EOF.
+#ifndef WDC_PLL_ZERO_COPY_RX
+#define WDC_PLL_ZERO_COPY_RX    1
+#endif
+
+//
+// Bus Baud Rates
+// The bus starts at WDC_PLL_BAUD_DEFAULT. The base can move it to any
+// other rate in WDC_PLL_BAUD_SUPPORTED (bit n set for rate n) during
+// enumeration (see wdc_datalink.h).
+//
+#define WDC_PLL_BAUD_250K       0
+#define WDC_PLL_BAUD_500K       1
+#define WDC_PLL_BAUD_1M         2
+#define WDC_PLL_BAUD_2M         3
+#define WDC_PLL_BAUD_COUNT      4
 
+#define WDC_PLL_BAUD_RATE_0     250000UL
+#define WDC_PLL_BAUD_RATE_1     500000UL
+#define WDC_PLL_BAUD_RATE_2     1000000UL
+#define WDC_PLL_BAUD_RATE_3     2000000UL
+
+#ifndef WDC_PLL_BAUD_DEFAULT
+#define WDC_PLL_BAUD_DEFAULT    WDC_PLL_BAUD_500K
+#endif
+
+//
 // UART Baudrate Settings
-#if WDC_PROTOCOL_VERSION == 0x0100
-#define WDC_UART_BAUD           500000UL
+// The UART always runs in double-speed (U2X) mode. A rate is usable if
+// the nearest UBRR setting gets within WDC_UART_BAUD_TOLERANCE (tenths
+// of a percent) of it on this F_CPU. This is the same calculation as
+// SerialBaudSetting in HardwareSerial.h, in a form C files can use.
+//
+#define WDC_UART_BAUD_TOLERANCE 20
+
+#define WDC_UART_UBRR(baud)     ((F_CPU + 4UL * (baud)) / (8UL * (baud)) - 1)
+#define WDC_UART_ACTUAL(baud)   (F_CPU / (8UL * (WDC_UART_UBRR(baud) + 1)))
+#define WDC_UART_ERROR(baud) \
+  (((WDC_UART_ACTUAL(baud) > (baud)) ? (WDC_UART_ACTUAL(baud) - (baud)) : \
+                                       ((baud) - WDC_UART_ACTUAL(baud))) * 1000UL / (baud))
+#define WDC_UART_BAUD_OK(baud) \
+  (((F_CPU / 8UL) >= (baud)) && (WDC_UART_ERROR(baud) <= WDC_UART_BAUD_TOLERANCE))
+
+#if WDC_UART_BAUD_OK(WDC_PLL_BAUD_RATE_0)
+#define WDC_PLL_BAUD_SUPPORTED_0  (1 << 0)
 #else
-#define WDC_UART_BAUD           500000UL
+#define WDC_PLL_BAUD_SUPPORTED_0  0
 #endif
+#if WDC_UART_BAUD_OK(WDC_PLL_BAUD_RATE_1)
+#define WDC_PLL_BAUD_SUPPORTED_1  (1 << 1)
+#else
+#define WDC_PLL_BAUD_SUPPORTED_1  0
+#endif
+#if WDC_UART_BAUD_OK(WDC_PLL_BAUD_RATE_2)
+#define WDC_PLL_BAUD_SUPPORTED_2  (1 << 2)
+#else
+#define WDC_PLL_BAUD_SUPPORTED_2  0
+#endif
+#if WDC_UART_BAUD_OK(WDC_PLL_BAUD_RATE_3)
+#define WDC_PLL_BAUD_SUPPORTED_3  (1 << 3)
+#else
+#define WDC_PLL_BAUD_SUPPORTED_3  0
+#endif
+
+#define WDC_PLL_BAUD_SUPPORTED  (WDC_PLL_BAUD_SUPPORTED_0 | WDC_PLL_BAUD_SUPPORTED_1 | \
+                                 WDC_PLL_BAUD_SUPPORTED_2 | WDC_PLL_BAUD_SUPPORTED_3)
 
-/* Exported Types ----------------------------------------------------------- */
-typedef void (*eof_callback_t)(void);
-typedef void (*sof_callback_t)(void);
+#if !(WDC_PLL_BAUD_SUPPORTED & (1 << WDC_PLL_BAUD_DEFAULT))
+#error "The default WDC baud rate is not supported on this device."
+#endif
 
 /* Function Prototypes ------------------------------------------------------ */
 void  WDC_PLLInit(void);
 void  WDC_PLLDeinit(void);
-bool  WDC_IsBusActive(void);
-void  WDC_PLLWritePacket(uint8_t *packet, uint16_t len);
-bool  WDC_PLLCanRead(void);
-int   WDC_PLLPeek(void);
-bool  WDC_PLLReadPacket(uint8_t *packet);
-void  WDC_PLLFlushReadPacket(void);
-
-void  WDC_PLLRegisterStartOfFrameCallback(eof_callback_t cb);
-void  WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb);
+void  WDC_PLLTask(void);
+bool  WDC_PLLBusIsActive(uint8_t bus);
+bool  WDC_PLLBusWritePacket(uint8_t bus, const uint8_t *packet, uint16_t len,
+                            uint8_t baud);
+bool  WDC_PLLBusIsTransmitting(uint8_t bus);
+bool  WDC_PLLBusCanRead(uint8_t bus);
+int   WDC_PLLBusPeek(uint8_t bus);
+uint16_t WDC_PLLBusReadPacket(uint8_t bus, uint8_t *packet, uint16_t len);
+void  WDC_PLLBusFlushReadPacket(uint8_t bus);
+uint16_t WDC_PLLBusGetFrame(uint8_t bus, uint8_t **frame, uint32_t *timestamp);
+void  WDC_PLLBusReleaseFrame(uint8_t bus);
+void  WDC_PLLBusReadStats(uint8_t bus, pll_stats_t *stats, bool clear);
+uint8_t WDC_PLLBusGetBaud(uint8_t bus);
+
+void  WDC_PLLBusRegisterStartOfFrameCallback(uint8_t bus, sof_callback_t cb);
+void  WDC_PLLBusRegisterEndOfFrameCallback(uint8_t bus, eof_callback_t cb);
+
+/* Inline Functions --------------------------------------------------------- */
+//
+// The single-bus interface shared with the other PHYs. Each acts on
+// bus 0.
+//
+static inline bool WDC_IsBusActive(void)
+{
+  return WDC_PLLBusIsActive(0);
+}
+
+static inline bool WDC_PLLWritePacket(const uint8_t *packet, uint16_t len,
+                                      uint8_t baud)
+{
+  return WDC_PLLBusWritePacket(0, packet, len, baud);
+}
+
+static inline bool WDC_PLLIsTransmitting(void)
+{
+  return WDC_PLLBusIsTransmitting(0);
+}
+
+static inline bool WDC_PLLCanRead(void)
+{
+  return WDC_PLLBusCanRead(0);
+}
+
+static inline int WDC_PLLPeek(void)
+{
+  return WDC_PLLBusPeek(0);
+}
+
+static inline uint16_t WDC_PLLReadPacket(uint8_t *packet, uint16_t len)
+{
+  return WDC_PLLBusReadPacket(0, packet, len);
+}
+
+static inline void WDC_PLLFlushReadPacket(void)
+{
+  WDC_PLLBusFlushReadPacket(0);
+}
+
+static inline uint16_t WDC_PLLGetFrame(uint8_t **frame, uint32_t *timestamp)
+{
+  return WDC_PLLBusGetFrame(0, frame, timestamp);
+}
+
+static inline void WDC_PLLReleaseFrame(void)
+{
+  WDC_PLLBusReleaseFrame(0);
+}
+
+static inline void WDC_PLLReadStats(pll_stats_t *stats, bool clear)
+{
+  WDC_PLLBusReadStats(0, stats, clear);
+}
+
+static inline uint8_t WDC_PLLGetBaud(void)
+{
+  return WDC_PLLBusGetBaud(0);
+}
+
+static inline void WDC_PLLRegisterStartOfFrameCallback(sof_callback_t cb)
+{
+  WDC_PLLBusRegisterStartOfFrameCallback(0, cb);
+}
+
+static inline void WDC_PLLRegisterEndOfFrameCallback(eof_callback_t cb)
+{
+  WDC_PLLBusRegisterEndOfFrameCallback(0, cb);
+}
 
 #ifdef __cplusplus
 }